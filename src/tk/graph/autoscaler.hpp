@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "tk/graph/pipeline.hpp"
+#include "tk/graph/stats.hpp"
+#include "tk/util/clock.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/// When an Autoscaler adds or parks instances of a replicated node
+struct AutoscalePolicy {
+  /// fewest active instances of every replicated node
+  size_t min_replicas{1};
+  /// most active instances over all replicated nodes, 0 for no limit
+  size_t max_total{0};
+  /// time between two decisions
+  std::chrono::milliseconds interval{20};
+  /// grow when the fullest input queue holds at least this fraction of its capacity
+  double grow_depth{0.5};
+  /// shrink only when the fullest input queue holds at most this fraction of its capacity
+  double shrink_depth{0.1};
+  /// busy time of the active instances over wall time above which a node is saturated
+  double target_utilization{0.8};
+};
+
+/**
+ * @brief Moves Pipeline threads to the current bottleneck
+ *
+ * Every interval, the input queue depth and the busy time recorded in GraphStats decide for
+ * each replicated node: a node with a filling queue and saturated instances gets one more
+ * instance, a node with an empty queue that would stay below the target utilization with
+ * one instance less gets one less. When AutoscalePolicy::max_total is reached, the least
+ * utilized other node gives up an instance to the node with the fullest queue.
+ *
+ * Active instances start at AutoscalePolicy::min_replicas and never exceed Node::replicas().
+ *
+ * @note stats must be the GraphStats attached to the pipeline, both must outlive the autoscaler
+ */
+class Autoscaler : private Noncopy {
+ public:
+  using clock = ::util::Clock;
+
+  /// @exception std::invalid_argument stats has fewer counters than the pipeline has nodes
+  Autoscaler(Pipeline& pipeline, const GraphStats& stats, AutoscalePolicy policy = {})
+      : pipeline_(pipeline), stats_(stats), policy_(policy) {
+    if (stats_.size() < pipeline_.size()) throw std::invalid_argument("GraphStats is smaller than the pipeline");
+    for (Node* n : pipeline_.replicatedNodes()) {
+      pipeline_.setActiveReplicas(n, policy_.min_replicas);
+      nodes_.push_back({n, stats_.get(static_cast<u32_t>(n->id())).total_ns});
+    }
+    last_ = clock::now();
+    thread_ = std::thread(&Autoscaler::loop, this);
+  }
+
+  ~Autoscaler() {
+    {
+      std::lock_guard<std::mutex> lk(mtx_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  /// Number of instance count changes so far
+  size_t resizes() const {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return resizes_;
+  }
+
+ private:
+  struct Tracked {
+    Node* node;
+    u64_t busy_ns;
+  };
+
+  struct Sample {
+    Node* node;
+    size_t active;
+    double depth;
+    double utilization;
+  };
+
+  void loop() {
+    std::unique_lock<std::mutex> lk(mtx_);
+    while (!cv_.wait_for(lk, policy_.interval, [this]() { return stop_; })) step();
+  }
+
+  void step() {
+    auto now = clock::now();
+    double elapsed = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_).count());
+    last_ = now;
+    if (elapsed <= 0) return;
+
+    samples_.clear();
+    size_t total = 0;
+    for (Tracked& t : nodes_) {
+      u64_t busy = stats_.get(static_cast<u32_t>(t.node->id())).total_ns;
+      size_t active = pipeline_.activeReplicas(t.node);
+      double depth = static_cast<double>(pipeline_.queueDepth(t.node)) / pipeline_.capacity();
+      samples_.push_back({t.node, active, depth, (busy - t.busy_ns) / (elapsed * active)});
+      t.busy_ns = busy;
+      total += active;
+    }
+
+    // shrink first, it frees instances for the nodes that grow
+    for (Sample& s : samples_) {
+      if (s.active <= policy_.min_replicas || s.depth > policy_.shrink_depth) continue;
+      if (s.utilization * s.active < policy_.target_utilization * (s.active - 1)) {
+        resize(s, s.active - 1);
+        --total;
+      }
+    }
+
+    std::sort(samples_.begin(), samples_.end(), [](const Sample& a, const Sample& b) { return a.depth > b.depth; });
+    for (Sample& s : samples_) {
+      if (s.active >= s.node->replicas() || s.depth < policy_.grow_depth) continue;
+      if (s.utilization < policy_.target_utilization) continue;
+      if (policy_.max_total && total >= policy_.max_total) {
+        // take an instance from the least utilized node that can spare one
+        Sample* donor = nullptr;
+        for (Sample& d : samples_) {
+          if (&d == &s || d.active <= policy_.min_replicas || d.utilization >= s.utilization) continue;
+          if (!donor || d.utilization < donor->utilization) donor = &d;
+        }
+        if (!donor) continue;
+        resize(*donor, donor->active - 1);
+        --total;
+      }
+      resize(s, s.active + 1);
+      ++total;
+    }
+  }
+
+  void resize(Sample& s, size_t active) {
+    pipeline_.setActiveReplicas(s.node, active);
+    s.active = active;
+    ++resizes_;
+  }
+
+  Pipeline& pipeline_;
+  const GraphStats& stats_;
+  AutoscalePolicy policy_;
+  std::vector<Tracked> nodes_;
+  std::vector<Sample> samples_;
+  clock::time_point last_;
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_{false};
+  size_t resizes_{0};
+  std::thread thread_;
+};
+
+}  // namespace tk
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "tk/graph/graph.hpp"
+
+namespace tk {
+
+/// When a BatchNode flushes the items accumulated so far
+struct BatchPolicy {
+  /// flush as soon as this many items are queued
+  size_t max_size{32};
+  /// flush once this long has passed since the first item of the batch was taken from its
+  /// input queue; time an item spent queued before that is not counted
+  std::chrono::microseconds max_wait{1000};
+};
+
+/**
+ * @brief Node processing several items with one call
+ *
+ * In a Pipeline, items accumulate until BatchPolicy::max_size is reached or
+ * BatchPolicy::max_wait has passed since the first item of the batch was taken, then
+ * processBatch() is invoked once for all of them.
+ * Other executors see a batch of one item.
+ */
+class BatchNode : public Node {
+ public:
+  explicit BatchNode(const std::string& name, BatchPolicy policy = {}) : Node(name), policy_(policy) {
+    if (policy_.max_size == 0) policy_.max_size = 1;
+  }
+
+  /**
+   * @brief Process a batch of items
+   *
+   * @param batch Inputs of each item, in arrival order
+   * @return std::vector<Packet> One output per item, in the same order
+   */
+  virtual std::vector<Packet> processBatch(const std::vector<std::vector<Packet>>& batch) = 0;
+
+  Packet process(const std::vector<Packet>& inputs) override {
+    std::vector<std::vector<Packet>> batch(1, inputs);
+    std::vector<Packet> out = processBatch(batch);
+    return out.empty() ? Packet{} : std::move(out.front());
+  }
+
+  const BatchPolicy& batchPolicy() const noexcept { return policy_; }
+
+ private:
+  BatchPolicy policy_;
+};
+
+}  // namespace tk
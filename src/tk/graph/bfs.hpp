@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "gsl/gsl-lite.hpp"
+#include "tk/graph/frozen.hpp"
+#include "tk/util/atomic_bitset.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+namespace detail {
+
+/// Reusable barrier for a fixed team of threads
+class SpinBarrier {
+ public:
+  explicit SpinBarrier(size_t n) : n_(n) {}
+
+  void wait() noexcept {
+    size_t gen = gen_.load(std::memory_order_acquire);
+    if (count_.fetch_add(1, std::memory_order_acq_rel) + 1 == n_) {
+      count_.store(0, std::memory_order_relaxed);
+      gen_.fetch_add(1, std::memory_order_release);
+      return;
+    }
+    for (unsigned round = 0; gen_.load(std::memory_order_acquire) == gen; ++round) {
+      if (round >= 64) std::this_thread::yield();
+    }
+  }
+
+ private:
+  size_t n_;
+  std::atomic<size_t> count_{0};
+  std::atomic<size_t> gen_{0};
+};
+
+}  // namespace detail
+
+/**
+ * @brief Level-synchronous parallel breadth-first search over a FrozenGraph
+ *
+ * Direction-optimizing (Beamer et al., SC'12): while the frontier is small every frontier
+ * node pushes to its unvisited neighbours (top-down); once the edges leaving the frontier
+ * outnumber a fraction of the unexplored edges, every unvisited node instead looks for a
+ * parent in the frontier and stops at the first one (bottom-up). Visited set and bottom-up
+ * frontiers are bitsets, work is handed out to the threads in chunks.
+ *
+ * Usage:
+ *
+ * ParallelBfs bfs;
+ * FrozenGraph f = g.freeze();
+ * bfs.run(f, node->id());  // everything downstream of node
+ * if (bfs.level(v) != ParallelBfs::kUnreached) ...
+ */
+class ParallelBfs : private Noncopy {
+ public:
+  enum class Direction {
+    /// follow successors
+    DOWNSTREAM,
+    /// follow predecessors
+    UPSTREAM
+  };
+
+  static constexpr u32_t kUnreached = ~u32_t(0);
+
+  explicit ParallelBfs(size_t threads = std::thread::hardware_concurrency()) : threads_(std::max<size_t>(threads, 1)) {}
+
+  /**
+   * @brief Search g from sources, results stay available until the next run
+   *
+   * @param g Graph to search
+   * @param sources Level 0 nodes, ids out of range are ignored
+   * @param dir Edge direction to follow
+   * @return const std::vector<u32_t>& Level of every node, kUnreached if not reachable
+   */
+  const std::vector<u32_t>& run(const FrozenGraph& g, gsl::span<const u32_t> sources, Direction dir = Direction::DOWNSTREAM) {
+    size_t n = g.size();
+    g_ = &g;
+    forward_ = dir == Direction::DOWNSTREAM;
+    level_.assign(n, kUnreached);
+    visited_.resize(n);
+    frontier_.clear();
+    depth_ = 0;
+    reached_ = 0;
+    bottom_up_steps_ = 0;
+    bottom_up_ = false;
+    done_ = false;
+    unexplored_ = g.edgeSize();
+    for (u32_t s : sources) {
+      if (s < n && visited_.set(s)) {
+        level_[s] = 0;
+        frontier_.push_back(s);
+        unexplored_ -= degree(s);
+      }
+    }
+    reached_ = frontier_size_ = frontier_.size();
+    if (frontier_.empty()) return level_;
+    frontier_edges_ = g.edgeSize() - unexplored_;
+
+    size_t team = std::min(threads_, n / kMinNodesPerThread + 1);
+    parts_.assign(team, Part());
+    detail::SpinBarrier barrier(team);
+    std::vector<std::thread> helpers;
+    helpers.reserve(team - 1);
+    for (size_t t = 1; t < team; ++t) helpers.emplace_back(&ParallelBfs::work, this, t, std::ref(barrier));
+    work(0, barrier);
+    for (auto& th : helpers) th.join();
+    return level_;
+  }
+
+  const std::vector<u32_t>& run(const FrozenGraph& g, u32_t source, Direction dir = Direction::DOWNSTREAM) {
+    return run(g, gsl::span<const u32_t>(&source, 1), dir);
+  }
+
+  const std::vector<u32_t>& levels() const noexcept { return level_; }
+  u32_t level(u32_t u) const noexcept { return level_[u]; }
+  /// Number of nodes reached, sources included
+  size_t reached() const noexcept { return reached_; }
+  /// Highest level reached
+  u32_t depth() const noexcept { return depth_; }
+  /// Number of levels expanded bottom-up
+  size_t bottomUpSteps() const noexcept { return bottom_up_steps_; }
+
+  /// Switch to bottom-up when edges leaving the frontier exceed unexplored edges / kAlpha
+  static constexpr size_t kAlpha = 14;
+  /// Switch back to top-down when the frontier shrinks below nodes / kBeta
+  static constexpr size_t kBeta = 24;
+
+ private:
+  static constexpr size_t kMinNodesPerThread = 4096;
+  static constexpr size_t kChunk = 256;
+  static constexpr size_t kWordChunk = 16;
+
+  struct alignas(64) Part {
+    std::vector<u32_t> next;
+    size_t found{0};
+    size_t edges{0};
+  };
+
+  gsl::span<const u32_t> adjacent(u32_t u) const noexcept {
+    return forward_ ? g_->successors(u) : g_->predecessors(u);
+  }
+  gsl::span<const u32_t> parents(u32_t u) const noexcept {
+    return forward_ ? g_->predecessors(u) : g_->successors(u);
+  }
+  size_t degree(u32_t u) const noexcept { return forward_ ? g_->outDegree(u) : g_->inDegree(u); }
+
+  void work(size_t self, detail::SpinBarrier& barrier) {
+    while (true) {
+      if (bottom_up_) {
+        bottomUp(self);
+      } else {
+        topDown(self);
+      }
+      barrier.wait();
+      if (self == 0) advance();
+      barrier.wait();
+      if (done_) return;
+    }
+  }
+
+  void topDown(size_t self) {
+    Part& part = parts_[self];
+    part.next.clear();
+    part.edges = 0;
+    u32_t next_level = depth_ + 1;
+    size_t size = frontier_.size();
+    for (size_t begin; (begin = cursor_.fetch_add(kChunk, std::memory_order_relaxed)) < size;) {
+      size_t end = std::min(begin + kChunk, size);
+      for (size_t i = begin; i < end; ++i) {
+        for (u32_t v : adjacent(frontier_[i])) {
+          if (visited_.test(v) || !visited_.set(v)) continue;
+          level_[v] = next_level;
+          part.next.push_back(v);
+          part.edges += degree(v);
+        }
+      }
+    }
+    part.found = part.next.size();
+  }
+
+  void bottomUp(size_t self) {
+    Part& part = parts_[self];
+    part.found = 0;
+    part.edges = 0;
+    u32_t next_level = depth_ + 1;
+    size_t words = visited_.words();
+    for (size_t begin; (begin = cursor_.fetch_add(kWordChunk, std::memory_order_relaxed)) < words;) {
+      size_t end = std::min(begin + kWordChunk, words);
+      for (size_t w = begin; w < end; ++w) {
+        // every word is owned by a single thread during the step
+        u64_t todo = ~visited_.word(w) & visited_.validMask(w);
+        u64_t found = 0;
+        for (; todo; todo &= todo - 1) {
+          u32_t v = static_cast<u32_t>(w * util::AtomicBitset::kWordBits + __builtin_ctzll(todo));
+          for (u32_t p : parents(v)) {
+            if (!front_.test(p)) continue;
+            level_[v] = next_level;
+            found |= todo & (~todo + 1);
+            part.edges += degree(v);
+            ++part.found;
+            break;
+          }
+        }
+        next_.storeWord(w, found);
+        if (found) visited_.orWord(w, found);
+      }
+    }
+  }
+
+  /// Merge the step results and pick the direction of the next step, run by one thread
+  void advance() {
+    cursor_.store(0, std::memory_order_relaxed);
+    size_t found = 0, edges = 0;
+    for (Part& p : parts_) {
+      found += p.found;
+      edges += p.edges;
+    }
+    if (bottom_up_) ++bottom_up_steps_;
+    if (found == 0) {
+      done_ = true;
+      return;
+    }
+    ++depth_;
+    reached_ += found;
+    unexplored_ -= edges;
+    size_t prev = frontier_size_;
+    frontier_size_ = found;
+    frontier_edges_ = edges;
+
+    if (!bottom_up_) {
+      frontier_.clear();
+      for (Part& p : parts_) frontier_.insert(frontier_.end(), p.next.begin(), p.next.end());
+      if (frontier_edges_ > unexplored_ / kAlpha) {
+        bottom_up_ = true;
+        front_.resize(g_->size());
+        next_.resize(g_->size());
+        for (u32_t u : frontier_) front_.set(u);
+      }
+    } else {
+      front_.swap(next_);
+      if (found < g_->size() / kBeta && found < prev) {
+        bottom_up_ = false;
+        frontier_.clear();
+        for (size_t w = 0; w < front_.words(); ++w) {
+          for (u64_t bits = front_.word(w); bits; bits &= bits - 1) {
+            frontier_.push_back(static_cast<u32_t>(w * util::AtomicBitset::kWordBits + __builtin_ctzll(bits)));
+          }
+        }
+      }
+    }
+  }
+
+  size_t threads_;
+  const FrozenGraph* g_{nullptr};
+  bool forward_{true};
+  std::vector<u32_t> level_;
+  util::AtomicBitset visited_;
+  /// top-down frontier
+  std::vector<u32_t> frontier_;
+  /// bottom-up frontier and the one being built
+  util::AtomicBitset front_, next_;
+  std::vector<Part> parts_;
+  alignas(64) std::atomic<size_t> cursor_{0};
+  bool bottom_up_{false};
+  bool done_{false};
+  u32_t depth_{0};
+  size_t reached_{0};
+  size_t unexplored_{0};
+  size_t frontier_size_{0};
+  size_t frontier_edges_{0};
+  size_t bottom_up_steps_{0};
+};
+
+}  // namespace tk
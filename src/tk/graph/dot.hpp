@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+
+#include "tk/graph/graph.hpp"
+#include "tk/graph/stats.hpp"
+
+namespace tk {
+
+namespace detail {
+
+inline void writeDotEscaped(std::ostream& os, std::string_view s) {
+  for (char c : s) {
+    if (c == '"' || c == '\\') os << '\\';
+    if (c == '\n') {
+      os << "\\n";
+    } else {
+      os << c;
+    }
+  }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Write g in Graphviz DOT format
+ *
+ * With stats, every node is labelled with its invocation count, mean and max execution time
+ * and mean input queue depth, and filled from white to red by its share of the total
+ * execution time, so bottlenecks stand out. Render with e.g. `dot -Tsvg`.
+ *
+ * @param os Output stream
+ * @param g Graph to export
+ * @param stats Counters collected by GraphExecutor or Pipeline, nullptr for topology only
+ */
+inline void writeDot(std::ostream& os, const Graph& g, const GraphStats* stats = nullptr) {
+  u64_t busiest = 0;
+  if (stats) {
+    for (size_t i = 0; i < g.size() && i < stats->size(); ++i) {
+      busiest = std::max(busiest, stats->get(static_cast<u32_t>(i)).total_ns);
+    }
+  }
+  os << "digraph G {\n  node [shape=box, style=filled, fillcolor=\"#ffffff\"];\n";
+  char buf[160];
+  for (size_t i = 0; i < g.size(); ++i) {
+    os << "  n" << i << " [label=\"";
+    detail::writeDotEscaped(os, g.node(i)->name());
+    if (stats && i < stats->size()) {
+      NodeStats s = stats->get(static_cast<u32_t>(i));
+      std::snprintf(buf, sizeof(buf), "\\n%llu calls, mean %.1f us, max %.1f us",
+                    static_cast<unsigned long long>(s.count), s.meanNs() / 1e3, s.max_ns / 1e3);
+      os << buf;
+      if (s.depth_samples) {
+        std::snprintf(buf, sizeof(buf), "\\nqueue mean %.1f, max %llu", s.meanDepth(),
+                      static_cast<unsigned long long>(s.depth_max));
+        os << buf;
+      }
+      // white for idle nodes, saturated red for the busiest one
+      int heat = busiest ? static_cast<int>(255 - 255.0 * s.total_ns / busiest) : 255;
+      std::snprintf(buf, sizeof(buf), "\", fillcolor=\"#ff%02x%02x", heat, heat);
+      os << buf;
+    }
+    os << "\"];\n";
+  }
+  for (size_t i = 0; i < g.size(); ++i) {
+    Node* u = g.node(i);
+    for (size_t j = 0; j < u->downSize(); ++j) os << "  n" << i << " -> n" << u->down(j)->id() << ";\n";
+  }
+  os << "}\n";
+}
+
+}  // namespace tk
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+class Node;
+
+/**
+ * @brief Edge array of a Node
+ *
+ * A growable array of Node pointers drawing memory from a std::pmr::memory_resource, so that
+ * the edges of an arena backed Graph live in the graph arena next to the nodes.
+ *
+ * Small lists are searched linearly. Once a list grows beyond kHashThreshold edges it also
+ * keeps an open addressing hash index from Node to position, and erase() leaves a tombstone
+ * instead of shifting the following edges. The array is compacted, in order, once tombstones
+ * outnumber live edges or on the next begin(), end() or operator[]. contains() and erase()
+ * of high fan-out nodes are therefore O(1) amortized, and edge order is always kept.
+ *
+ * @note The first read after an erase() may compact the array, so it must not race with
+ *       other reads of the same list
+ */
+class EdgeList : private Noncopy {
+ public:
+  using const_iterator = Node* const*;
+  static constexpr u32_t kHashThreshold = 32;
+
+  EdgeList() = default;
+  ~EdgeList() { release(); }
+
+  /// Drop all edges and draw further memory from mr
+  void reset(std::pmr::memory_resource* mr) {
+    release();
+    mr_ = mr;
+  }
+
+  const_iterator begin() const noexcept {
+    compact();
+    return data_;
+  }
+  const_iterator end() const noexcept {
+    compact();
+    return data_ + len_;
+  }
+  size_t size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+  Node* operator[](size_t idx) const noexcept {
+    compact();
+    return data_[idx];
+  }
+
+  bool contains(const Node* n) const noexcept {
+    if (slots_) return slots_[probe(n)].node == n;
+    return std::find(data_, data_ + len_, n) != data_ + len_;
+  }
+
+  /**
+   * @brief Allocate room for n edges, and their hash index when n exceeds kHashThreshold
+   *
+   * Avoids the intermediate arrays left behind by growing one edge at a time, which a
+   * monotonic arena never reclaims.
+   */
+  void reserve(size_t n) {
+    if (n > cap_) reallocate(static_cast<u32_t>(n));
+    if (n > kHashThreshold) {
+      u32_t slot_count = 4 * kHashThreshold;
+      while (slot_count < 2 * n) slot_count <<= 1;
+      if (slot_count > slot_mask_ + 1) rehash(slot_count);
+    }
+  }
+  size_t capacity() const noexcept { return cap_; }
+
+  void push_back(Node* n) {
+    if (len_ == cap_) {
+      compact();
+      if (len_ == cap_) grow();
+    }
+    data_[len_++] = n;
+    ++size_;
+    if (slots_) {
+      if (2 * size_ > slot_mask_ + 1) rehash(2 * (slot_mask_ + 1));
+      insertSlot(n, len_ - 1);
+    } else if (size_ > kHashThreshold) {
+      rehash(4 * kHashThreshold);
+    }
+  }
+
+  /**
+   * @brief Remove n, keeping the order of the other edges
+   *
+   * Node::up() order is the order of process() inputs, so the following edges must not be
+   * reordered: small lists shift them down, hashed lists leave a tombstone.
+   */
+  bool erase(const Node* n) noexcept {
+    if (slots_) {
+      u32_t slot = probe(n);
+      if (slots_[slot].node != n) return false;
+      data_[slots_[slot].pos] = nullptr;
+      eraseSlot(slot);
+      --size_;
+      if (len_ - size_ > size_) compact();
+      return true;
+    }
+    Node** match = std::find(data_, data_ + len_, n);
+    if (match == data_ + len_) return false;
+    std::copy(match + 1, data_ + len_, match);
+    --len_;
+    --size_;
+    return true;
+  }
+
+ private:
+  void grow() { reallocate(cap_ ? cap_ * 2 : 4); }
+
+  void reallocate(u32_t cap) {
+    Node** p = static_cast<Node**>(mr_->allocate(cap * sizeof(Node*), alignof(Node*)));
+    compact();
+    std::copy(data_, data_ + len_, p);
+    if (data_) mr_->deallocate(data_, cap_ * sizeof(Node*), alignof(Node*));
+    data_ = p;
+    cap_ = cap;
+  }
+
+  void release() noexcept {
+    if (data_) mr_->deallocate(data_, cap_ * sizeof(Node*), alignof(Node*));
+    releaseSlots();
+    data_ = nullptr;
+    len_ = size_ = cap_ = 0;
+  }
+
+  /*------------------ hash index -------------------*/
+  struct Slot {
+    const Node* node;
+    u32_t pos;
+  };
+
+  u32_t hash(const Node* n) const noexcept {
+    u64_t h = (reinterpret_cast<uintptr_t>(n) >> 3) * 0x9E3779B97F4A7C15ull;
+    return static_cast<u32_t>(h >> 32) & slot_mask_;
+  }
+
+  /// Slot holding n, or the empty slot where n would go
+  u32_t probe(const Node* n) const noexcept {
+    u32_t i = hash(n);
+    while (slots_[i].node && slots_[i].node != n) i = (i + 1) & slot_mask_;
+    return i;
+  }
+
+  void insertSlot(const Node* n, u32_t pos) noexcept {
+    u32_t i = probe(n);
+    slots_[i] = {n, pos};
+  }
+
+  /// Linear probing removal by backward shift, no tombstones
+  void eraseSlot(u32_t hole) noexcept {
+    u32_t i = hole;
+    while (true) {
+      i = (i + 1) & slot_mask_;
+      if (!slots_[i].node) break;
+      u32_t home = hash(slots_[i].node);
+      // move entry i into the hole unless its home lies cyclically in (hole, i]
+      if (((i - home) & slot_mask_) >= ((i - hole) & slot_mask_)) {
+        slots_[hole] = slots_[i];
+        hole = i;
+      }
+    }
+    slots_[hole] = {nullptr, 0};
+  }
+
+  void rehash(u32_t slot_count) {
+    compact();
+    releaseSlots();
+    slots_ = static_cast<Slot*>(mr_->allocate(slot_count * sizeof(Slot), alignof(Slot)));
+    std::fill(slots_, slots_ + slot_count, Slot{nullptr, 0});
+    slot_mask_ = slot_count - 1;
+    for (u32_t i = 0; i < len_; ++i) insertSlot(data_[i], i);
+  }
+
+  /// Drop tombstones, moving live edges down in order and updating their positions
+  void compact() const noexcept {
+    if (len_ == size_) return;
+    u32_t out = 0;
+    for (u32_t i = 0; i < len_; ++i) {
+      Node* n = data_[i];
+      if (!n) continue;
+      if (out != i) {
+        data_[out] = n;
+        slots_[probe(n)].pos = out;
+      }
+      ++out;
+    }
+    len_ = out;
+  }
+
+  void releaseSlots() noexcept {
+    if (slots_) mr_->deallocate(slots_, (slot_mask_ + 1) * sizeof(Slot), alignof(Slot));
+    slots_ = nullptr;
+    slot_mask_ = 0;
+  }
+
+  Node** data_{nullptr};
+  /// used positions, live edges and tombstones
+  mutable u32_t len_{0};
+  /// live edges
+  u32_t size_{0};
+  u32_t cap_{0};
+  Slot* slots_{nullptr};
+  u32_t slot_mask_{0};
+  std::pmr::memory_resource* mr_{std::pmr::new_delete_resource()};
+};
+
+}  // namespace tk
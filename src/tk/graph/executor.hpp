@@ -0,0 +1,361 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "tk/graph/frozen.hpp"
+#include "tk/graph/fusion.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/graph/pending.hpp"
+#include "tk/graph/plan.hpp"
+#include "tk/graph/profiler.hpp"
+#include "tk/graph/scheduling.hpp"
+#include "tk/graph/stats.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+#include "tk/util/ws_deque.hpp"
+
+namespace tk {
+
+/**
+ * @brief Runs a Graph on a fixed pool of worker threads
+ *
+ * A node becomes runnable once all of its upstream nodes have finished. Every worker owns a
+ * work-stealing deque: newly readied nodes go to the local deque, one of them is run directly
+ * by the same worker, idle workers steal from the others. Independent branches therefore
+ * spread across workers while a linear chain stays on one thread.
+ *
+ * Maximal linear chains are fused before running (see FusedChains): their nodes execute back
+ * to back within one task, without touching the deques or the pending counters.
+ *
+ * Any number of threads may call run() at the same time. Runs sharing a compiled Plan only
+ * allocate their pending counters and output slots.
+ *
+ * A SchedulingPolicy replaces the per-worker deques with one queue ordered by rank, trading
+ * some contention for running the most urgent work first when the pool is overloaded.
+ *
+ * @note Graph topology must not be modified while it is running
+ */
+class GraphExecutor : private Noncopy {
+ public:
+  explicit GraphExecutor(size_t num_workers = std::thread::hardware_concurrency()) {
+    if (num_workers == 0) num_workers = 1;
+    workers_.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) workers_.emplace_back(new Worker);
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers_[i]->thread = std::thread(&GraphExecutor::loop, this, i);
+    }
+  }
+
+  ~GraphExecutor() {
+    {
+      std::lock_guard<std::mutex> lk(park_mtx_);
+      stop_ = true;
+    }
+    park_cv_.notify_all();
+    for (auto& w : workers_) w->thread.join();
+  }
+
+  size_t workers() const { return workers_.size(); }
+
+  /**
+   * @brief Record every node execution into profiler, nullptr to disable
+   *
+   * @note Call only while no run is in progress
+   */
+  void setProfiler(Profiler* profiler) {
+    if (profiler) profiler->attach(workers_.size());
+    profiler_ = profiler;
+  }
+
+  /**
+   * @brief Aggregate node execution counters into stats, nullptr to disable
+   *
+   * @note Call only while no run is in progress
+   */
+  void setStats(GraphStats* stats) { stats_ = stats; }
+
+  /**
+   * @brief Order ready work by policy, nullptr for the default work-stealing order
+   *
+   * @note Call only while no run is in progress, policy must outlive its use
+   */
+  void setPolicy(const SchedulingPolicy* policy) { policy_.store(policy, std::memory_order_relaxed); }
+
+  /**
+   * @brief Run every node of the graph once, blocks until finished
+   *
+   * Compiles a Plan for this run only, keep a Plan to run the same graph repeatedly.
+   *
+   * @exception Rethrows the first exception thrown by Node::process
+   * @param g Graph to run
+   * @param input Input of root nodes
+   * @return std::vector<Packet> Outputs of sink nodes, in node id order
+   */
+  std::vector<Packet> run(Graph& g, const Packet& input = {}) { return run(Plan(g), input); }
+
+  /**
+   * @brief Run every node of a compiled graph once, blocks until finished
+   *
+   * @exception Rethrows the first exception thrown by Node::process
+   * @param plan Compiled graph, must outlive the call
+   * @param input Input of root nodes
+   * @param deadline Completion deadline, only used by a SchedulingPolicy
+   * @return std::vector<Packet> Outputs of sink nodes, in node id order
+   */
+  std::vector<Packet> run(const Plan& plan, const Packet& input = {},
+                          ::util::Clock::time_point deadline = ::util::Clock::time_point::max()) {
+    if (plan.size() == 0) return {};
+    Run r(plan, input, deadline);
+    std::vector<Task*> roots;
+    roots.reserve(plan.rootUnits().size());
+    for (u32_t k : plan.rootUnits()) roots.push_back(&r.tasks[k]);
+    if (policy_.load(std::memory_order_relaxed)) {
+      for (Task* t : roots) schedule(t);
+    } else {
+      inject(roots);
+    }
+    {
+      std::unique_lock<std::mutex> lk(r.mtx);
+      r.cv.wait(lk, [&r]() { return r.done; });
+    }
+    if (r.error) std::rethrow_exception(r.error);
+
+    std::vector<Packet> sinks;
+    sinks.reserve(plan.sinks().size());
+    for (u32_t i : plan.sinks()) sinks.emplace_back(std::move(r.outputs[i]));
+    return sinks;
+  }
+
+ private:
+  struct Run;
+  struct Task {
+    Run* run;
+    /// unit of Run::fusion
+    u32_t unit;
+  };
+
+  /// State of one graph run
+  struct Run {
+    Run(const Plan& p, const Packet& in, ::util::Clock::time_point deadline)
+        : plan(p),
+          graph(p.graph()),
+          fusion(p.units()),
+          pending(p.inDegrees()),
+          outputs(p.size()),
+          input(in),
+          info{::util::Clock::now(), deadline} {
+      size_t units = fusion.size();
+      tasks.resize(units);
+      for (size_t k = 0; k < units; ++k) tasks[k] = {this, static_cast<u32_t>(k)};
+      remaining.store(units, std::memory_order_relaxed);
+    }
+
+    const Plan& plan;
+    const FrozenGraph& graph;
+    const FusedChains& fusion;
+    PendingInputs pending;
+    std::vector<Packet> outputs;
+    std::vector<Task> tasks;
+    Packet input;
+    RunInfo info;
+    std::atomic<size_t> remaining{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done{false};
+  };
+
+  struct Worker {
+    util::WsDeque<Task*> deque;
+    std::thread thread;
+  };
+
+  /// Entry of the ranked queue, lowest rank then oldest on top
+  struct Ranked {
+    i64_t rank;
+    u64_t seq;
+    Task* task;
+    bool operator<(const Ranked& o) const noexcept { return rank != o.rank ? rank > o.rank : seq > o.seq; }
+  };
+
+  void loop(size_t self) {
+    std::minstd_rand rng(static_cast<u32_t>(self) + 1);
+    Task* t = nullptr;
+    while (true) {
+      if (!t) t = acquire(self, rng);
+      if (!t && !(t = spin(self, rng))) {
+        if (!park()) return;
+        continue;
+      }
+      t = execute(self, t);
+    }
+  }
+
+  /// Run the nodes of one unit, returns the next task to run on this worker if any
+  Task* execute(size_t self, Task* t) {
+    Run* r = t->run;
+    for (u32_t idx : r->fusion.unit(t->unit)) {
+      if (profiler_ || stats_) {
+        auto start = Profiler::clock::now();
+        invoke(r, idx);
+        auto end = Profiler::clock::now();
+        if (profiler_) profiler_->record(self, idx, start, end);
+        if (stats_) stats_->record(idx, start, end);
+      } else {
+        invoke(r, idx);
+      }
+    }
+
+    const SchedulingPolicy* policy = policy_.load(std::memory_order_relaxed);
+    Task* next = nullptr;
+    for (u32_t v : r->graph.successors(r->fusion.tail(t->unit))) {
+      if (!r->pending.arrive(v)) continue;
+      Task* ready = &r->tasks[r->fusion.unitOf(v)];
+      if (policy) {
+        schedule(ready);
+      } else if (!next) {
+        next = ready;
+      } else {
+        workers_[self]->deque.push(ready);
+        queued_.fetch_add(1);
+        notify();
+      }
+    }
+    // r may be destroyed by the waiting thread right after the last decrement
+    if (r->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard<std::mutex> lk(r->mtx);
+      r->done = true;
+      r->cv.notify_all();
+    }
+    return next;
+  }
+
+  void invoke(Run* r, u32_t idx) {
+    thread_local std::vector<Packet> inputs;
+    inputs.clear();
+    if (r->graph.inDegree(idx) == 0) {
+      inputs.push_back(r->input);
+    } else {
+      for (u32_t p : r->graph.predecessors(idx)) inputs.push_back(r->outputs[p]);
+    }
+    if (!r->failed.load(std::memory_order_relaxed)) {
+      try {
+        r->outputs[idx] = r->graph.node(idx)->process(inputs);
+      } catch (...) {
+        std::lock_guard<std::mutex> lk(r->mtx);
+        if (!r->error) r->error = std::current_exception();
+        r->failed.store(true, std::memory_order_relaxed);
+      }
+    }
+    inputs.clear();
+  }
+
+  /// Queue t by rank of the policy
+  void schedule(Task* t) {
+    i64_t rank = policy_.load(std::memory_order_relaxed)->rank(t->run->plan, t->unit, t->run->info);
+    {
+      std::lock_guard<std::mutex> lk(ranked_mtx_);
+      ranked_.push({rank, ranked_seq_++, t});
+    }
+    queued_.fetch_add(1);
+    notify();
+  }
+
+  Task* acquire(size_t self, std::minstd_rand& rng) {
+    Task* t = nullptr;
+    if (policy_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lk(ranked_mtx_);
+      if (ranked_.empty()) return nullptr;
+      t = ranked_.top().task;
+      ranked_.pop();
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return t;
+    }
+    if (workers_[self]->deque.pop(t)) {
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+      return t;
+    }
+    size_t n = workers_.size();
+    size_t start = rng() % n;
+    for (size_t i = 0; i < n; ++i) {
+      size_t victim = (start + i) % n;
+      if (victim != self && workers_[victim]->deque.steal(t)) {
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+        return t;
+      }
+    }
+    std::lock_guard<std::mutex> lk(inject_mtx_);
+    if (injected_.empty()) return nullptr;
+    t = injected_.front();
+    injected_.pop_front();
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    return t;
+  }
+
+  Task* spin(size_t self, std::minstd_rand& rng) {
+    for (int i = 0; i < 64; ++i) {
+      if (queued_.load(std::memory_order_relaxed) > 0) {
+        if (Task* t = acquire(self, rng)) return t;
+      }
+      std::this_thread::yield();
+    }
+    return nullptr;
+  }
+
+  /// Sleep until there is work, returns false when the executor is stopping
+  bool park() {
+    std::unique_lock<std::mutex> lk(park_mtx_);
+    sleeping_.fetch_add(1);
+    park_cv_.wait(lk, [this]() { return stop_ || queued_.load() > 0; });
+    sleeping_.fetch_sub(1);
+    return !stop_;
+  }
+
+  void notify() {
+    if (sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lk(park_mtx_);
+      park_cv_.notify_one();
+    }
+  }
+
+  void inject(const std::vector<Task*>& tasks) {
+    {
+      std::lock_guard<std::mutex> lk(inject_mtx_);
+      injected_.insert(injected_.end(), tasks.begin(), tasks.end());
+    }
+    queued_.fetch_add(tasks.size());
+    if (sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lk(park_mtx_);
+      park_cv_.notify_all();
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  Profiler* profiler_{nullptr};
+  GraphStats* stats_{nullptr};
+  /// read by idle workers, hence atomic
+  std::atomic<const SchedulingPolicy*> policy_{nullptr};
+  std::mutex ranked_mtx_;
+  std::priority_queue<Ranked> ranked_;
+  u64_t ranked_seq_{0};
+  std::mutex inject_mtx_;
+  std::deque<Task*> injected_;
+  /// number of tasks sitting in deques or the inject queue
+  alignas(64) std::atomic<i64_t> queued_{0};
+  alignas(64) std::atomic<int> sleeping_{0};
+  std::mutex park_mtx_;
+  std::condition_variable park_cv_;
+  bool stop_{false};
+};
+
+}  // namespace tk
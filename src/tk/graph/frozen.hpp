@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "gsl/gsl-lite.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/util/int_def.h"
+
+namespace tk {
+
+/**
+ * @brief Immutable compressed-sparse-row snapshot of a Graph
+ *
+ * Successors and predecessors of every node are stored as dense 32-bit node ids in two
+ * contiguous arrays, so traversals walk memory sequentially instead of chasing Node pointers.
+ * Vertex ids are Node::id(). Edges keep the link order of Node::down()/Node::up().
+ *
+ * @note The snapshot does not follow later changes of the source graph
+ */
+class FrozenGraph {
+ public:
+  FrozenGraph() = default;
+
+  size_t size() const noexcept { return nodes_.size(); }
+  size_t edgeSize() const noexcept { return succ_.size(); }
+  Node* node(u32_t u) const noexcept { return nodes_[u]; }
+
+  gsl::span<const u32_t> successors(u32_t u) const noexcept {
+    return gsl::span<const u32_t>(succ_.data() + succ_ofs_[u], succ_ofs_[u + 1] - succ_ofs_[u]);
+  }
+  gsl::span<const u32_t> predecessors(u32_t u) const noexcept {
+    return gsl::span<const u32_t>(pred_.data() + pred_ofs_[u], pred_ofs_[u + 1] - pred_ofs_[u]);
+  }
+  u32_t outDegree(u32_t u) const noexcept { return succ_ofs_[u + 1] - succ_ofs_[u]; }
+  u32_t inDegree(u32_t u) const noexcept { return pred_ofs_[u + 1] - pred_ofs_[u]; }
+  /// Nodes without predecessors, in Graph::roots() order
+  const std::vector<u32_t>& roots() const noexcept { return roots_; }
+
+  /// Bytes held by the snapshot
+  size_t memoryBytes() const noexcept {
+    return (succ_ofs_.capacity() + succ_.capacity() + pred_ofs_.capacity() + pred_.capacity()) * sizeof(u32_t) +
+           roots_.capacity() * sizeof(u32_t) + nodes_.capacity() * sizeof(Node*);
+  }
+
+ private:
+  friend class Graph;
+  std::vector<u32_t> succ_ofs_, succ_;
+  std::vector<u32_t> pred_ofs_, pred_;
+  std::vector<u32_t> roots_;
+  std::vector<Node*> nodes_;
+};
+
+inline FrozenGraph Graph::freeze() const {
+  FrozenGraph f;
+  size_t n = nodes_.size();
+  f.nodes_.reserve(n);
+  f.succ_ofs_.assign(n + 1, 0);
+  f.pred_ofs_.assign(n + 1, 0);
+  for (size_t i = 0; i < n; ++i) {
+    Node* u = nodes_[i];
+    f.nodes_.push_back(u);
+    f.succ_ofs_[i + 1] = f.succ_ofs_[i] + u->downSize();
+    f.pred_ofs_[i + 1] = f.pred_ofs_[i] + u->upSize();
+  }
+  f.succ_.reserve(f.succ_ofs_[n]);
+  f.pred_.reserve(f.pred_ofs_[n]);
+  for (size_t i = 0; i < n; ++i) {
+    Node* u = nodes_[i];
+    for (size_t j = 0; j < u->downSize(); ++j) f.succ_.push_back(u->down(j)->id());
+    for (size_t j = 0; j < u->upSize(); ++j) f.pred_.push_back(u->up(j)->id());
+  }
+  f.roots_.reserve(start_.size());
+  for (Node* r : start_) f.roots_.push_back(r->id());
+  return f;
+}
+
+}  // namespace tk
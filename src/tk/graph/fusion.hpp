@@ -0,0 +1,79 @@
+#pragma once
+
+#include <vector>
+
+#include "gsl/gsl-lite.hpp"
+#include "tk/graph/frozen.hpp"
+#include "tk/util/int_def.h"
+
+namespace tk {
+
+/**
+ * @brief Partition of a FrozenGraph into maximal linear chains
+ *
+ * v joins the chain of u when u has v as its only successor and v has u as its only
+ * predecessor. Every chain becomes one schedulable unit: its nodes run back to back on one
+ * thread, only the head waits for inputs and only the tail readies other units. Nodes outside
+ * any chain form units of one node.
+ *
+ * Unit heads keep their node's in-degree, so PendingInputs of the source graph can be used
+ * as is, arriving only on heads.
+ */
+class FusedChains {
+ public:
+  FusedChains() = default;
+  explicit FusedChains(const FrozenGraph& g) { build(g); }
+
+  void build(const FrozenGraph& g) {
+    u32_t n = static_cast<u32_t>(g.size());
+    unit_of_.assign(n, 0);
+    unit_ofs_.assign(1, 0);
+    nodes_.clear();
+    nodes_.reserve(n);
+    fused_ = 0;
+    chains_ = 0;
+    auto joinsPred = [&g](u32_t v) { return g.inDegree(v) == 1 && g.outDegree(g.predecessors(v)[0]) == 1; };
+    for (u32_t u = 0; u < n; ++u) {
+      if (joinsPred(u)) continue;
+      u32_t k = static_cast<u32_t>(unit_ofs_.size() - 1);
+      u32_t v = u;
+      while (true) {
+        unit_of_[v] = k;
+        nodes_.push_back(v);
+        if (g.outDegree(v) != 1 || !joinsPred(g.successors(v)[0])) break;
+        v = g.successors(v)[0];
+      }
+      u32_t len = static_cast<u32_t>(nodes_.size()) - unit_ofs_.back();
+      if (len > 1) {
+        fused_ += len;
+        ++chains_;
+      }
+      unit_ofs_.push_back(static_cast<u32_t>(nodes_.size()));
+    }
+  }
+
+  /// Number of schedulable units
+  size_t size() const noexcept { return unit_ofs_.size() - 1; }
+  /// Node ids of unit k, in execution order
+  gsl::span<const u32_t> unit(u32_t k) const noexcept {
+    return gsl::span<const u32_t>(nodes_.data() + unit_ofs_[k], unit_ofs_[k + 1] - unit_ofs_[k]);
+  }
+  u32_t head(u32_t k) const noexcept { return nodes_[unit_ofs_[k]]; }
+  u32_t tail(u32_t k) const noexcept { return nodes_[unit_ofs_[k + 1] - 1]; }
+  /// Unit containing node u
+  u32_t unitOf(u32_t u) const noexcept { return unit_of_[u]; }
+
+  /// Number of nodes placed in chains of two or more nodes
+  size_t fusedNodes() const noexcept { return fused_; }
+  /// Number of such chains
+  size_t chains() const noexcept { return chains_; }
+
+ private:
+  std::vector<u32_t> unit_ofs_;
+  std::vector<u32_t> nodes_;
+  std::vector<u32_t> unit_of_;
+  size_t fused_{0};
+  size_t chains_{0};
+};
+
+}  // namespace tk
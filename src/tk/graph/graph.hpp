@@ -1,50 +1,322 @@
 #pragma once
 
 #include <algorithm>
+#include <any>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include <memory>
+#include <memory_resource>
 #include "gsl/gsl-lite.hpp"
+#include "tk/graph/edge_list.hpp"
+#include "tk/util/int_def.h"
 #include "tk/util/noncopy.hpp"
+#include "tk/util/string_pool.hpp"
 
 namespace tk {
 
+/// Value flowing along an edge between two nodes
+using Packet = std::any;
+
+class Graph;
+class FrozenGraph;
+
 class Node: private Noncopy {
 public:
-  explicit Node(const std::string& name): name_(name) {}
+  explicit Node(const std::string& name): local_name_(name), name_(local_name_) {}
   virtual ~Node() = default;
+  /**
+   * @brief Node computation, invoked by executors once every upstream node has finished
+   *
+   * @param inputs Outputs of upstream nodes, or the run input for a root node
+   * @return Packet Output handed to every downstream node
+   */
+  virtual Packet process(const std::vector<Packet>& inputs) {
+    return inputs.empty() ? Packet{} : inputs.front();
+  }
+  /// Name of the node, interned in the graph string table once the node is added to a graph
+  std::string_view name() const { return name_; }
+  /// Dense index of this node inside its graph
+  size_t id() const { return id_; }
   Node* down(int idx) { return down_[idx]; }
-  bool link(Node* dn) {
-    if (std::any_of(down_.begin(), down_.end(), [dn](Node* n) { return n == dn; })) {
-      return false;
-    }
-    down_.emplace_back(dn);
-    return true;
+  size_t downSize() const { return down_.size(); }
+  Node* up(int idx) { return up_[idx]; }
+  size_t upSize() const { return up_.size(); }
+  /**
+   * @brief Add edge this -> dn
+   *
+   * @retval false Edge already exists, nodes belong to different graphs, or the edge would create a cycle
+   */
+  bool link(Node* dn);
+  /**
+   * @brief Remove edge this -> dn
+   *
+   * The order of the remaining down() and up() edges is kept, so dn's inputs keep their order.
+   *
+   * @retval false Edge does not exist
+   */
+  bool unlink(Node* dn);
+  /**
+   * @brief Allocate room for edges up front
+   *
+   * @param down Expected number of downstream nodes
+   * @param up Expected number of upstream nodes
+   */
+  void reserveEdges(size_t down, size_t up) {
+    down_.reserve(down);
+    up_.reserve(up);
   }
-  bool unlink(Node* dn) {
-    auto match = std::find(down_.begin(), down_.end(), dn);
-    if (match == down_.end()) return false;
-    down_.erase(match);
-    return true;
+  /**
+   * @brief Let Pipeline run n instances of this node on consecutive items at once
+   *
+   * The instances share this object, so process() must be safe to call concurrently.
+   * Ignored by BatchNode and by executors other than Pipeline.
+   *
+   * @param n Number of concurrent instances, 0 is treated as 1
+   * @param ordered Whether downstream nodes receive outputs in input order
+   */
+  void setReplicas(size_t n, bool ordered = true) {
+    replicas_ = static_cast<u32_t>(n ? n : 1);
+    ordered_ = ordered;
   }
+  size_t replicas() const { return replicas_; }
+  bool ordered() const { return ordered_; }
 
 private:
-  std::vector<gsl::not_null<Node*>> down_;
-  std::string name_;
+  friend class Graph;
+  EdgeList down_;
+  EdgeList up_;
+  /// owns the name until the node is added to a graph
+  std::string local_name_;
+  std::string_view name_;
+  Graph* graph_{nullptr};
+  size_t id_{0};
+  /// position in Graph::topoOrder()
+  u32_t ord_{0};
+  /// position in Graph::roots() while the node has no upstream
+  u32_t root_pos_{0};
+  /// search mark of topological reordering
+  u32_t visit_{0};
+  u32_t replicas_{1};
+  bool ordered_{true};
+};
+
+/// Where Graph places its nodes and their edge arrays
+enum class NodeStorage {
+  /// one heap allocation per node and per edge array
+  HEAP,
+  /// bump allocation in large blocks owned by the graph, released at once on destruction.
+  /// Memory freed before that is not reused: each time an edge array doubles the old one is
+  /// abandoned, so a hub node may hold about twice the memory of its edges. Reserve edges of
+  /// known hubs with Node::reserveEdges()
+  ARENA
+};
+
+/// Notified after every change of a Graph's topology
+class GraphObserver {
+public:
+  virtual ~GraphObserver() = default;
+  virtual void onAddNode(Node* /*n*/) {}
+  virtual void onLink(Node* /*up*/, Node* /*down*/) {}
+  virtual void onUnlink(Node* /*up*/, Node* /*down*/) {}
 };
 
 class Graph: private Noncopy {
 public:
-  virtual ~Graph() = default;
+  Graph() = default;
+  /**
+   * @param storage Node storage mode
+   * @param block_bytes Size of the first arena block, later blocks grow geometrically
+   */
+  explicit Graph(NodeStorage storage, size_t block_bytes = 1 << 20) {
+    if (storage == NodeStorage::ARENA) {
+      arena_.reset(new std::pmr::monotonic_buffer_resource(block_bytes, std::pmr::new_delete_resource()));
+    }
+  }
+  virtual ~Graph() {
+    for (Node* n : nodes_) {
+      if (arena_) {
+        n->~Node();
+      } else {
+        delete n;
+      }
+    }
+  }
+
   template <class N, typename... Args>
   Node* addNode(const std::string& name, Args&&... args) {
-    Node* n = new N(name, std::forward<Args>(args)...);
-    nodes_.emplace_back(n);
+    static_assert(std::is_base_of<Node, N>::value, "N is not derived from tk::Node");
+    Node* n;
+    if (arena_) {
+      // memory of a failed construction stays in the arena until destruction
+      n = new (arena_->allocate(sizeof(N), alignof(N))) N(name, std::forward<Args>(args)...);
+    } else {
+      n = new N(name, std::forward<Args>(args)...);
+    }
+    n->graph_ = this;
+    u32_t name_id = names_.intern(n->local_name_);
+    n->name_ = names_.view(name_id);
+    std::string().swap(n->local_name_);
+    if (name_id == by_name_.size()) by_name_.push_back(n);
+    n->id_ = nodes_.size();
+    n->ord_ = static_cast<u32_t>(order_.size());
+    n->down_.reset(resource());
+    n->up_.reset(resource());
+    nodes_.push_back(n);
+    order_.push_back(n);
+    addRoot(n);
+    for (GraphObserver* o : observers_) o->onAddNode(n);
     return n;
   }
+  /// Reserve room for node_count nodes in the graph bookkeeping
+  void reserve(size_t node_count) {
+    nodes_.reserve(node_count);
+    order_.reserve(node_count);
+    names_.reserve(node_count);
+  }
+  size_t size() const { return nodes_.size(); }
+  Node* node(size_t id) const { return nodes_[id]; }
+  /// First node added with the given name, nullptr if none
+  Node* find(std::string_view name) const {
+    u32_t name_id = names_.find(name);
+    return name_id == util::StringPool::npos ? nullptr : by_name_[name_id];
+  }
+  /// Interned node names
+  const util::StringPool& names() const { return names_; }
+  NodeStorage storage() const { return arena_ ? NodeStorage::ARENA : NodeStorage::HEAP; }
+  /// Immutable CSR snapshot of the current topology, defined in tk/graph/frozen.hpp
+  FrozenGraph freeze() const;
+  /// Nodes in topological order, maintained incrementally on every link
+  const std::vector<Node*>& topoOrder() const { return order_; }
+  /// Nodes without upstream, maintained on every link/unlink, in no particular order
+  const std::vector<gsl::not_null<Node*>>& roots() const { return start_; }
+
+  /// Notify o of later topology changes until removed, o must outlive the registration
+  void addObserver(GraphObserver* o) { observers_.push_back(o); }
+  void removeObserver(GraphObserver* o) {
+    observers_.erase(std::remove(observers_.begin(), observers_.end(), o), observers_.end());
+  }
 
 private:
-  std::vector<std::unique_ptr<Node>> nodes_;
+  friend class Node;
+
+  /**
+   * @brief Restore topological order before adding edge x -> y (Pearce-Kelly)
+   *
+   * Only nodes positioned between y and x are visited: those reachable from y are moved after
+   * those reaching x, reusing the same set of positions.
+   *
+   * @retval false Edge would create a cycle, order is left untouched
+   */
+  bool reorder(Node* x, Node* y) {
+    u32_t lb = y->ord_, ub = x->ord_;
+    if (lb > ub) return true;
+
+    delta_f_.clear();
+    delta_b_.clear();
+    // forward from y, bounded by x
+    u32_t mark = ++visit_epoch_;
+    stack_.assign(1, y);
+    y->visit_ = mark;
+    while (!stack_.empty()) {
+      Node* n = stack_.back();
+      stack_.pop_back();
+      delta_f_.push_back(n);
+      for (Node* w : n->down_) {
+        if (w == x) return false;
+        if (w->visit_ != mark && w->ord_ < ub) {
+          w->visit_ = mark;
+          stack_.push_back(w);
+        }
+      }
+    }
+    // backward from x, bounded by y
+    mark = ++visit_epoch_;
+    stack_.assign(1, x);
+    x->visit_ = mark;
+    while (!stack_.empty()) {
+      Node* n = stack_.back();
+      stack_.pop_back();
+      delta_b_.push_back(n);
+      for (Node* w : n->up_) {
+        if (w->visit_ != mark && w->ord_ > lb) {
+          w->visit_ = mark;
+          stack_.push_back(w);
+        }
+      }
+    }
+
+    auto by_ord = [](Node* a, Node* b) { return a->ord_ < b->ord_; };
+    std::sort(delta_f_.begin(), delta_f_.end(), by_ord);
+    std::sort(delta_b_.begin(), delta_b_.end(), by_ord);
+    slots_.clear();
+    for (Node* n : delta_b_) slots_.push_back(n->ord_);
+    for (Node* n : delta_f_) slots_.push_back(n->ord_);
+    std::inplace_merge(slots_.begin(), slots_.begin() + delta_b_.size(), slots_.end());
+    size_t i = 0;
+    for (Node* n : delta_b_) place(n, slots_[i++]);
+    for (Node* n : delta_f_) place(n, slots_[i++]);
+    return true;
+  }
+
+  void place(Node* n, u32_t ord) {
+    n->ord_ = ord;
+    order_[ord] = n;
+  }
+
+  void addRoot(Node* n) {
+    n->root_pos_ = static_cast<u32_t>(start_.size());
+    start_.emplace_back(n);
+  }
+
+  void removeRoot(Node* n) {
+    Node* last = start_.back();
+    start_[n->root_pos_] = last;
+    last->root_pos_ = n->root_pos_;
+    start_.pop_back();
+  }
+
+  std::pmr::memory_resource* resource() const {
+    return arena_ ? arena_.get() : std::pmr::new_delete_resource();
+  }
+
+  std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+  std::vector<Node*> nodes_;
   std::vector<gsl::not_null<Node*>> start_;
+  util::StringPool names_;
+  /// first node of each interned name, indexed by name id
+  std::vector<Node*> by_name_;
+  std::vector<Node*> order_;
+  std::vector<GraphObserver*> observers_;
+  u32_t visit_epoch_{0};
+  // scratch buffers of reorder
+  std::vector<Node*> stack_, delta_f_, delta_b_;
+  std::vector<u32_t> slots_;
 };
 
+inline bool Node::link(Node* dn) {
+  if (dn == this || dn->graph_ != graph_) return false;
+  if (down_.contains(dn)) return false;
+  if (graph_ && !graph_->reorder(this, dn)) return false;
+  down_.push_back(dn);
+  dn->up_.push_back(this);
+  if (graph_) {
+    if (dn->up_.size() == 1) graph_->removeRoot(dn);
+    for (GraphObserver* o : graph_->observers_) o->onLink(this, dn);
+  }
+  return true;
+}
+
+inline bool Node::unlink(Node* dn) {
+  if (!down_.erase(dn)) return false;
+  dn->up_.erase(this);
+  if (graph_) {
+    if (dn->up_.empty()) graph_->addRoot(dn);
+    for (GraphObserver* o : graph_->observers_) o->onUnlink(this, dn);
+  }
+  return true;
+}
+
 }  // namespace tk
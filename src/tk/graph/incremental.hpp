@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+
+#include "tk/graph/graph.hpp"
+#include "tk/graph/plan.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/**
+ * @brief Reruns only the part of a graph affected by a change
+ *
+ * Keeps the output of every node between runs. Marking a node dirty also marks everything
+ * downstream of it, run() then processes the dirty nodes in topological order and reuses the
+ * cached outputs of the clean ones. Every node is dirty before the first run.
+ *
+ * Usage:
+ *
+ * IncrementalRunner inc(g);
+ * inc.run(input);
+ * inc.markDirty(node);  // node's parameters changed
+ * inc.run(input);       // processes node and its downstream only
+ *
+ * @note Graph topology must not be modified while the runner exists
+ */
+class IncrementalRunner : private Noncopy {
+ public:
+  explicit IncrementalRunner(const Graph& g) : plan_(g), outputs_(plan_.size()), dirty_(plan_.size(), 1) {}
+
+  /// Mark u and all nodes downstream of it for recomputation
+  void markDirty(const Node* u) { markDirty(static_cast<u32_t>(u->id())); }
+
+  void markDirty(u32_t u) {
+    if (dirty_[u]) return;
+    const FrozenGraph& g = plan_.graph();
+    dirty_[u] = 1;
+    stack_.push_back(u);
+    while (!stack_.empty()) {
+      u32_t v = stack_.back();
+      stack_.pop_back();
+      // the dirty set is closed under successors, a dirty node needs no further walk
+      for (u32_t w : g.successors(v)) {
+        if (dirty_[w]) continue;
+        dirty_[w] = 1;
+        stack_.push_back(w);
+      }
+    }
+  }
+
+  /// Mark every node for recomputation
+  void markAllDirty() { dirty_.assign(dirty_.size(), 1); }
+
+  bool dirty(const Node* u) const noexcept { return dirty_[u->id()]; }
+
+  /**
+   * @brief Process dirty nodes, blocks until finished
+   *
+   * Root nodes receive input; when it differs from the previous run, mark the roots dirty.
+   *
+   * @exception Rethrows an exception of Node::process, the failed node and everything not
+   * yet processed stay dirty
+   * @return std::vector<Packet> Outputs of sink nodes, in node id order
+   */
+  std::vector<Packet> run(const Packet& input = {}) {
+    const FrozenGraph& g = plan_.graph();
+    recomputed_ = skipped_ = 0;
+    std::vector<Packet> inputs;
+    for (u32_t u : plan_.order()) {
+      if (!dirty_[u]) {
+        ++skipped_;
+        continue;
+      }
+      inputs.clear();
+      if (g.inDegree(u) == 0) {
+        inputs.push_back(input);
+      } else {
+        for (u32_t p : g.predecessors(u)) inputs.push_back(outputs_[p]);
+      }
+      outputs_[u] = g.node(u)->process(inputs);
+      dirty_[u] = 0;
+      ++recomputed_;
+    }
+    std::vector<Packet> sinks;
+    sinks.reserve(plan_.sinks().size());
+    for (u32_t u : plan_.sinks()) sinks.push_back(outputs_[u]);
+    return sinks;
+  }
+
+  /// Cached output of u from the last run that processed it
+  const Packet& output(const Node* u) const noexcept { return outputs_[u->id()]; }
+
+  /// Nodes processed by the last run
+  size_t recomputed() const noexcept { return recomputed_; }
+  /// Nodes whose cached output the last run reused
+  size_t skipped() const noexcept { return skipped_; }
+
+ private:
+  Plan plan_;
+  std::vector<Packet> outputs_;
+  std::vector<u8_t> dirty_;
+  std::vector<u32_t> stack_;
+  size_t recomputed_{0};
+  size_t skipped_{0};
+};
+
+}  // namespace tk
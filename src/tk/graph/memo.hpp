@@ -0,0 +1,75 @@
+#pragma once
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tk/graph/graph.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/lru_cache.hpp"
+
+namespace tk {
+
+/// How a Memoized node caches its outputs
+struct MemoPolicy {
+  /**
+   * Fingerprint of a node's inputs. Equal fingerprints must mean equal inputs: a collision
+   * returns the output cached for other inputs.
+   */
+  std::function<u64_t(const std::vector<Packet>&)> hasher;
+  /// Maximum number of cached outputs
+  size_t capacity{1024};
+  /// Number of independently locked cache shards
+  size_t shards{16};
+};
+
+/**
+ * @brief Node N whose outputs are cached by input fingerprint
+ *
+ * N::process must be pure: the same inputs always give the same output. On a hit the cached
+ * output is returned without calling N::process. The cache is shared by every run and safe
+ * to use from concurrent runs.
+ *
+ * Usage:
+ *
+ * g.addNode<Memoized<Resize>>("resize", MemoPolicy{hashImage, 256}, resize_args...);
+ *
+ * @tparam N Node type, constructible from a name followed by its own arguments
+ */
+template <class N>
+class Memoized : public N {
+  static_assert(std::is_base_of<Node, N>::value, "N is not derived from tk::Node");
+
+ public:
+  /// @exception std::invalid_argument policy has no hasher
+  template <class... Args>
+  Memoized(const std::string& name, MemoPolicy policy, Args&&... args)
+      : N(name, std::forward<Args>(args)...),
+        hasher_(std::move(policy.hasher)),
+        cache_(policy.capacity, policy.shards) {
+    if (!hasher_) throw std::invalid_argument("MemoPolicy has no hasher");
+  }
+
+  Packet process(const std::vector<Packet>& inputs) override {
+    u64_t key = hasher_(inputs);
+    Packet out;
+    if (cache_.get(key, out)) return out;
+    out = N::process(inputs);
+    cache_.put(key, out);
+    return out;
+  }
+
+  u64_t hits() const { return cache_.hits(); }
+  u64_t misses() const { return cache_.misses(); }
+  size_t cached() const { return cache_.size(); }
+  void clearCache() { cache_.clear(); }
+
+ private:
+  std::function<u64_t(const std::vector<Packet>&)> hasher_;
+  util::ConcurrentLru<u64_t, Packet> cache_;
+};
+
+}  // namespace tk
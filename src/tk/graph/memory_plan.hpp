@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "gsl/gsl-lite.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/graph/reachability.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/**
+ * @brief Offsets of node output buffers inside one arena shared by a run
+ *
+ * The buffer of node u is live from the start of u until its last downstream node has
+ * finished; a sink's buffer is live until the end of the run. Two buffers may overlap only
+ * when one is dead before the other is written, which holds in every execution order, even
+ * parallel ones, when every downstream node of u is strictly upstream of v. Buffers are then
+ * placed largest first at the lowest offset free of every conflicting buffer placed before.
+ *
+ * The plan is computed for the topology at construction and must be rebuilt after it changes.
+ */
+class MemoryPlan {
+ public:
+  /**
+   * @param g Graph to plan
+   * @param output_bytes Output buffer size of every node, by Node::id()
+   * @param alignment Alignment of every buffer offset, a power of two
+   */
+  MemoryPlan(Graph& g, const std::vector<size_t>& output_bytes, size_t alignment = 64)
+      : alignment_(alignment), offsets_(g.size(), 0), bytes_(output_bytes) {
+    if (output_bytes.size() != g.size()) throw std::invalid_argument("output_bytes does not match the graph size");
+    if (alignment == 0 || (alignment & (alignment - 1))) throw std::invalid_argument("alignment is not a power of two");
+    size_t n = g.size();
+    for (size_t b : bytes_) total_ += b;
+
+    ReachabilityIndex reach(g);
+    // whether the buffer of a is dead before b starts
+    auto before = [&](Node* a, Node* b) {
+      if (a->downSize() == 0) return false;
+      for (size_t j = 0; j < a->downSize(); ++j) {
+        if (!reach.reachable(a->down(j), b)) return false;
+      }
+      return true;
+    };
+
+    std::vector<u32_t> by_size;
+    for (u32_t i = 0; i < n; ++i) {
+      if (bytes_[i]) by_size.push_back(i);
+    }
+    std::stable_sort(by_size.begin(), by_size.end(), [&](u32_t a, u32_t b) { return bytes_[a] > bytes_[b]; });
+
+    std::vector<u32_t> placed;
+    std::vector<std::pair<size_t, size_t>> taken;
+    for (u32_t u : by_size) {
+      Node* nu = g.node(u);
+      taken.clear();
+      for (u32_t v : placed) {
+        Node* nv = g.node(v);
+        if (!before(nu, nv) && !before(nv, nu)) taken.emplace_back(offsets_[v], offsets_[v] + bytes_[v]);
+      }
+      std::sort(taken.begin(), taken.end());
+      size_t offset = 0;
+      for (auto& t : taken) {
+        if (offset + bytes_[u] <= t.first) break;
+        offset = std::max(offset, align(t.second));
+      }
+      offsets_[u] = offset;
+      arena_ = std::max(arena_, offset + bytes_[u]);
+      placed.push_back(u);
+    }
+  }
+
+  /// Offset of n's output buffer in the arena
+  size_t offset(const Node* n) const { return offsets_[n->id()]; }
+  /// Size of n's output buffer
+  size_t bytes(const Node* n) const { return bytes_[n->id()]; }
+  /// Arena size, the peak memory of a run
+  size_t arenaBytes() const noexcept { return arena_; }
+  /// Sum of all buffer sizes, the memory of a run without sharing
+  size_t totalBytes() const noexcept { return total_; }
+  size_t alignment() const noexcept { return alignment_; }
+
+ private:
+  size_t align(size_t offset) const noexcept { return (offset + alignment_ - 1) & ~(alignment_ - 1); }
+
+  size_t alignment_;
+  std::vector<size_t> offsets_;
+  std::vector<size_t> bytes_;
+  size_t arena_{0};
+  size_t total_{0};
+};
+
+/**
+ * @brief Memory block laid out by a MemoryPlan
+ *
+ * One arena serves one run at a time; concurrent runs each need their own.
+ */
+class MemoryArena : private Noncopy {
+ public:
+  /// @param plan Layout, must outlive the arena
+  explicit MemoryArena(const MemoryPlan& plan)
+      : plan_(plan),
+        data_(static_cast<u8_t*>(
+            ::operator new(std::max<size_t>(plan.arenaBytes(), 1), std::align_val_t(plan.alignment())))) {}
+  ~MemoryArena() { ::operator delete(data_, std::align_val_t(plan_.alignment())); }
+
+  /// Output buffer of n
+  gsl::span<u8_t> buffer(const Node* n) const { return {data_ + plan_.offset(n), plan_.bytes(n)}; }
+  size_t size() const noexcept { return plan_.arenaBytes(); }
+
+ private:
+  const MemoryPlan& plan_;
+  u8_t* data_;
+};
+
+}  // namespace tk
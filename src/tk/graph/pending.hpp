@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "gsl/gsl-lite.hpp"
+#include "tk/graph/frozen.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/**
+ * @brief Per-execution count of unfinished upstream nodes
+ *
+ * Every node starts at its in-degree. Each finishing predecessor calls arrive() on its
+ * successors, exactly one of those calls observes the last input and fires the node, so no
+ * scan over the graph is needed to find runnable nodes.
+ */
+class PendingInputs : private Noncopy {
+ public:
+  PendingInputs() = default;
+  explicit PendingInputs(const FrozenGraph& g) { reset(g); }
+  /// @param initial Initial count of every node, usually Plan::inDegrees()
+  explicit PendingInputs(gsl::span<const u32_t> initial) { reset(initial); }
+
+  /// Re-arm every counter to the in-degree of its node
+  void reset(const FrozenGraph& g) {
+    if (size_ != g.size()) {
+      size_ = g.size();
+      counters_.reset(new std::atomic<u32_t>[size_]);
+    }
+    for (u32_t u = 0; u < size_; ++u) counters_[u].store(g.inDegree(u), std::memory_order_relaxed);
+  }
+
+  /// Re-arm every counter from initial
+  void reset(gsl::span<const u32_t> initial) {
+    if (size_ != initial.size()) {
+      size_ = initial.size();
+      counters_.reset(new std::atomic<u32_t>[size_]);
+    }
+    for (u32_t u = 0; u < size_; ++u) counters_[u].store(initial[u], std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief One input of u is ready
+   *
+   * Acquire-release ordering makes everything written by all predecessors of u visible to
+   * the thread that fires it.
+   *
+   * @retval true It was the last pending input, u is now runnable
+   */
+  bool arrive(u32_t u) noexcept { return counters_[u].fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+  u32_t pending(u32_t u) const noexcept { return counters_[u].load(std::memory_order_relaxed); }
+  size_t size() const noexcept { return size_; }
+
+ private:
+  std::unique_ptr<std::atomic<u32_t>[]> counters_;
+  size_t size_{0};
+};
+
+}  // namespace tk
@@ -0,0 +1,452 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "tk/graph/batch.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/graph/profiler.hpp"
+#include "tk/graph/stats.hpp"
+#include "tk/util/noncopy.hpp"
+#include "tk/util/spsc_queue.hpp"
+
+namespace tk {
+
+namespace detail {
+
+/// Spin, then yield, then sleep while waiting on a queue
+inline void backoff(unsigned& round) {
+  if (round < 64) {
+    ++round;
+  } else if (round < 128) {
+    ++round;
+    std::this_thread::yield();
+  } else {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
+
+}  // namespace detail
+
+/**
+ * @brief Streaming execution of a Graph
+ *
+ * Every edge created by Node::link becomes a bounded lock-free queue and every node runs on
+ * its own thread, so consecutive items are in flight at different stages at the same time.
+ * A node takes one item from each input edge, processes them, and pushes the result to each
+ * output edge, blocking while a downstream queue is full (backpressure).
+ *
+ * A BatchNode collects items per its BatchPolicy before processing them with one call.
+ *
+ * A node with Node::replicas() > 1 runs on that many threads which take turns to pop the
+ * next item from the inputs and to push results, so every edge keeps a single producer and
+ * a single consumer. Ordered replicas pass results through a reorder buffer of twice the
+ * replica count; an instance waits while the buffer is full. setActiveReplicas() parks
+ * instances at runtime, see Autoscaler.
+ *
+ * Root nodes read from the pipeline input, sink nodes write to the pipeline output.
+ * push() must be called from a single thread, and so must pop().
+ *
+ * @note Graph topology must not be modified while the pipeline exists
+ */
+class Pipeline : private Noncopy {
+ public:
+  /**
+   * @brief Build the queues and start one thread per node
+   *
+   * @param g Graph to stream through
+   * @param capacity Capacity of every edge queue
+   * @param profiler Records every node execution if not nullptr, thread index is Node::id(),
+   *                 extra replica threads follow the last node id
+   * @param stats Aggregates execution counters and input queue depth if not nullptr
+   */
+  explicit Pipeline(Graph& g, size_t capacity = 64, Profiler* profiler = nullptr, GraphStats* stats = nullptr)
+      : capacity_(capacity), profiler_(profiler), stats_(stats) {
+    size_t n = g.size();
+    stages_.reserve(n);
+    for (size_t i = 0; i < n; ++i) stages_.emplace_back(new Stage(g.node(i)));
+    size_t threads = n;
+    for (auto& st : stages_) {
+      if (st->node->replicas() > 1 && !dynamic_cast<BatchNode*>(st->node)) {
+        st->rep.reset(new Replicas(st->node->replicas(), st->node->ordered()));
+        threads += st->node->replicas() - 1;
+      }
+    }
+    if (profiler_) profiler_->attach(threads);
+    for (auto& st : stages_) {
+      Node* node = st->node;
+      if (node->upSize() == 0) {
+        edges_.emplace_back(new Edge(capacity));
+        st->in.push_back(edges_.back().get());
+        sources_.push_back(edges_.back().get());
+      }
+      for (size_t j = 0; j < node->downSize(); ++j) {
+        edges_.emplace_back(new Edge(capacity));
+        st->out.push_back(edges_.back().get());
+      }
+      if (node->downSize() == 0) {
+        edges_.emplace_back(new Edge(capacity));
+        st->out.push_back(edges_.back().get());
+        sinks_.push_back(edges_.back().get());
+      }
+    }
+    // input edges follow Node::up() order
+    for (auto& st : stages_) {
+      Node* node = st->node;
+      for (size_t j = 0; j < node->downSize(); ++j) {
+        Node* dn = node->down(j);
+        Stage* ds = stages_[dn->id()].get();
+        ds->in.resize(dn->upSize(), nullptr);
+        for (size_t k = 0; k < dn->upSize(); ++k) {
+          if (dn->up(k) == node) ds->in[k] = st->out[j];
+        }
+      }
+    }
+    size_t extra = n;
+    for (auto& st : stages_) {
+      size_t id = st->node->id();
+      if (auto* batch = dynamic_cast<BatchNode*>(st->node)) {
+        st->threads.emplace_back(&Pipeline::batchLoop, this, st.get(), batch);
+      } else if (st->rep) {
+        st->threads.emplace_back(&Pipeline::replicaLoop, this, st.get(), 0, id);
+        for (size_t r = 1; r < st->node->replicas(); ++r) {
+          st->threads.emplace_back(&Pipeline::replicaLoop, this, st.get(), r, extra++);
+        }
+      } else {
+        st->threads.emplace_back(&Pipeline::loop, this, st.get());
+      }
+    }
+  }
+
+  ~Pipeline() {
+    close();
+    stop_.store(true, std::memory_order_relaxed);
+    for (auto& st : stages_) {
+      for (std::thread& t : st->threads) t.join();
+    }
+  }
+
+  /**
+   * @brief Feed one item to every root node, blocks while the input queues are full
+   *
+   * @retval false Pipeline is closed or failed
+   */
+  bool push(const Packet& item) {
+    if (closed_ || failed()) return false;
+    for (Edge* e : sources_) {
+      if (!pushEdge(e, item)) return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Take the outputs of sink nodes for the next item, blocks until available
+   *
+   * @exception Rethrows the first exception thrown by Node::process once the stream stops
+   * @param out Outputs of sink nodes, in node id order
+   * @retval false End of stream
+   */
+  bool pop(std::vector<Packet>& out) {
+    out.clear();
+    for (Edge* e : sinks_) {
+      Packet p;
+      if (!popEdge(e, p)) {
+        std::lock_guard<std::mutex> lk(err_mtx_);
+        if (error_) std::rethrow_exception(error_);
+        return false;
+      }
+      out.emplace_back(std::move(p));
+    }
+    return true;
+  }
+
+  /// End of input, items already pushed still flow through
+  void close() {
+    if (closed_) return;
+    closed_ = true;
+    for (Edge* e : sources_) e->closed.store(true, std::memory_order_release);
+  }
+
+  /// Number of nodes streamed through
+  size_t size() const noexcept { return stages_.size(); }
+
+  /// Nodes running more than one instance, see Node::setReplicas()
+  std::vector<Node*> replicatedNodes() const {
+    std::vector<Node*> nodes;
+    for (auto& st : stages_) {
+      if (st->rep) nodes.push_back(st->node);
+    }
+    return nodes;
+  }
+
+  /// Instances of n taking items, 1 for a node without replicas
+  size_t activeReplicas(const Node* n) const {
+    const Stage& st = *stages_[n->id()];
+    return st.rep ? st.rep->active.load(std::memory_order_relaxed) : 1;
+  }
+
+  /**
+   * @brief Change the number of instances of n taking items, ignored without replicas
+   *
+   * Parked instances finish their current item first.
+   *
+   * @param count Clamped to [1, Node::replicas()]
+   */
+  void setActiveReplicas(const Node* n, size_t count) {
+    Stage& st = *stages_[n->id()];
+    if (!st.rep) return;
+    count = std::min(std::max<size_t>(count, 1), st.node->replicas());
+    st.rep->active.store(count, std::memory_order_relaxed);
+  }
+
+  /// Items waiting on the fullest input edge of n
+  size_t queueDepth(const Node* n) const { return depth(stages_[n->id()].get()); }
+  /// Capacity of every edge queue
+  size_t capacity() const noexcept { return capacity_; }
+
+ private:
+  struct Edge {
+    explicit Edge(size_t capacity) : queue(capacity) {}
+    util::SpscQueue<Packet> queue;
+    /// set by the producer after its last push
+    std::atomic<bool> closed{false};
+  };
+
+  /// Shared state of the threads of a replicated node
+  struct Replicas {
+    Replicas(size_t count, bool ordered_output)
+        : ordered(ordered_output), window(2 * count), slots(window), ready(window, 0), live(count), active(count) {}
+    const bool ordered;
+    const size_t window;
+    /// held while popping inputs
+    std::mutex in_mtx;
+    u64_t next_in{0};
+    std::atomic<bool> eos{false};
+    /// held while pushing outputs
+    std::mutex out_mtx;
+    std::atomic<u64_t> next_out{0};
+    /// reorder buffer indexed by sequence number modulo window
+    std::vector<Packet> slots;
+    std::vector<char> ready;
+    std::atomic<size_t> live;
+    /// instances with a lower index take items, the others are parked
+    std::atomic<size_t> active;
+  };
+
+  struct Stage {
+    explicit Stage(Node* n) : node(n) {}
+    Node* node;
+    std::vector<Edge*> in;
+    std::vector<Edge*> out;
+    std::unique_ptr<Replicas> rep;
+    std::vector<std::thread> threads;
+  };
+
+  bool failed() const { return stop_.load(std::memory_order_relaxed); }
+
+  bool pushEdge(Edge* e, const Packet& item) {
+    unsigned round = 0;
+    while (!e->queue.tryPush(item)) {
+      if (failed()) return false;
+      detail::backoff(round);
+    }
+    return true;
+  }
+
+  bool popEdge(Edge* e, Packet& item) {
+    unsigned round = 0;
+    while (!e->queue.tryPop(item)) {
+      if (e->closed.load(std::memory_order_acquire)) return e->queue.tryPop(item);
+      if (failed()) return false;
+      detail::backoff(round);
+    }
+    return true;
+  }
+
+  void loop(Stage* st) {
+    std::vector<Packet> inputs;
+    while (true) {
+      inputs.clear();
+      inputs.resize(st->in.size());
+      bool eos = false;
+      for (size_t i = 0; i < st->in.size() && !eos; ++i) eos = !popEdge(st->in[i], inputs[i]);
+      if (eos) break;
+      Packet out;
+      if (!execute(st, st->node->id(), 1, [&]() { out = st->node->process(inputs); })) break;
+      bool ok = true;
+      for (Edge* e : st->out) ok = ok && pushEdge(e, out);
+      if (!ok) break;
+    }
+    for (Edge* e : st->out) e->closed.store(true, std::memory_order_release);
+  }
+
+  /// Instance index of a replicated node, thread is its profiler thread index
+  void replicaLoop(Stage* st, size_t index, size_t thread) {
+    Replicas& rep = *st->rep;
+    std::vector<Packet> inputs;
+    bool ok = true;
+    while (ok) {
+      unsigned parked = 0;
+      while (index >= rep.active.load(std::memory_order_relaxed) && !failed() &&
+             !rep.eos.load(std::memory_order_relaxed)) {
+        detail::backoff(parked);
+      }
+      u64_t seq;
+      {
+        std::lock_guard<std::mutex> lk(rep.in_mtx);
+        if (rep.eos.load(std::memory_order_relaxed)) break;
+        // an earlier item still in process would otherwise let the reorder buffer overflow
+        unsigned round = 0;
+        while (rep.ordered && rep.next_in - rep.next_out.load(std::memory_order_acquire) >= rep.window) {
+          if (failed()) break;
+          detail::backoff(round);
+        }
+        inputs.clear();
+        inputs.resize(st->in.size());
+        bool eos = false;
+        for (size_t i = 0; i < st->in.size() && !eos; ++i) eos = !popEdge(st->in[i], inputs[i]);
+        if (eos || failed()) {
+          rep.eos.store(true, std::memory_order_relaxed);
+          break;
+        }
+        seq = rep.next_in++;
+      }
+      Packet out;
+      if (!execute(st, thread, 1, [&]() { out = st->node->process(inputs); })) break;
+      std::lock_guard<std::mutex> lk(rep.out_mtx);
+      if (!rep.ordered) {
+        for (Edge* e : st->out) ok = ok && pushEdge(e, out);
+        continue;
+      }
+      rep.slots[seq % rep.window] = std::move(out);
+      rep.ready[seq % rep.window] = 1;
+      // flush the run of consecutive items starting at the oldest one
+      u64_t next = rep.next_out.load(std::memory_order_relaxed);
+      while (ok && rep.ready[next % rep.window]) {
+        Packet& item = rep.slots[next % rep.window];
+        for (Edge* e : st->out) ok = ok && pushEdge(e, item);
+        item = Packet{};
+        rep.ready[next % rep.window] = 0;
+        rep.next_out.store(++next, std::memory_order_release);
+      }
+    }
+    // the last instance to leave ends the stream
+    if (rep.live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      for (Edge* e : st->out) e->closed.store(true, std::memory_order_release);
+    }
+  }
+
+  /**
+   * @brief Invoke call, which processes items for st's node, timed when profiled or counted
+   *
+   * @param thread Profiler thread index
+   * @retval false call threw, the first exception is kept for pop() and the stream stops
+   */
+  template <typename F>
+  bool execute(const Stage* st, size_t thread, u64_t items, F&& call) {
+    try {
+      if (profiler_ || stats_) {
+        u32_t id = static_cast<u32_t>(st->node->id());
+        if (stats_) stats_->recordDepth(id, depth(st));
+        auto start = Profiler::clock::now();
+        call();
+        auto end = Profiler::clock::now();
+        if (profiler_) profiler_->record(thread, id, start, end);
+        if (stats_) stats_->record(id, start, end, items);
+      } else {
+        call();
+      }
+      return true;
+    } catch (...) {
+      std::lock_guard<std::mutex> lk(err_mtx_);
+      if (!error_) error_ = std::current_exception();
+      stop_.store(true, std::memory_order_relaxed);
+      return false;
+    }
+  }
+
+  /// Items still queued on the fullest input edge of st
+  static size_t depth(const Stage* st) {
+    size_t d = 0;
+    for (Edge* e : st->in) d = std::max(d, e->queue.size());
+    return d;
+  }
+
+  enum class Poll { READY, EMPTY, END };
+
+  /// Whether every input edge of st holds an item, without blocking
+  Poll poll(Stage* st) const {
+    Poll state = Poll::READY;
+    for (Edge* e : st->in) {
+      if (e->queue.size() > 0) continue;
+      // the producer may have pushed its last items right before closing
+      if (e->closed.load(std::memory_order_acquire) && e->queue.size() == 0) return Poll::END;
+      state = Poll::EMPTY;
+    }
+    return failed() ? Poll::END : state;
+  }
+
+  void batchLoop(Stage* st, BatchNode* node) {
+    const BatchPolicy& policy = node->batchPolicy();
+    std::vector<std::vector<Packet>> batch;
+    bool eos = false;
+    while (!eos) {
+      batch.clear();
+      // first item blocks, it starts the deadline
+      batch.emplace_back(st->in.size());
+      for (size_t i = 0; i < st->in.size() && !eos; ++i) eos = !popEdge(st->in[i], batch.back()[i]);
+      if (eos) break;
+      auto deadline = Profiler::clock::now() + policy.max_wait;
+      unsigned round = 0;
+      while (batch.size() < policy.max_size) {
+        Poll state = poll(st);
+        if (state == Poll::END) {
+          eos = true;
+          break;
+        }
+        if (state == Poll::EMPTY) {
+          if (Profiler::clock::now() >= deadline) break;
+          detail::backoff(round);
+          continue;
+        }
+        batch.emplace_back(st->in.size());
+        for (size_t i = 0; i < st->in.size(); ++i) st->in[i]->queue.tryPop(batch.back()[i]);
+      }
+
+      std::vector<Packet> out;
+      bool processed = execute(st, node->id(), batch.size(), [&]() {
+        out = node->processBatch(batch);
+        if (out.size() != batch.size()) throw std::logic_error("processBatch returned a wrong number of outputs");
+      });
+      if (!processed) break;
+      bool ok = true;
+      for (Packet& item : out) {
+        for (Edge* e : st->out) ok = ok && pushEdge(e, item);
+      }
+      if (!ok) break;
+    }
+    for (Edge* e : st->out) e->closed.store(true, std::memory_order_release);
+  }
+
+  size_t capacity_;
+  Profiler* profiler_;
+  GraphStats* stats_;
+  std::vector<std::unique_ptr<Stage>> stages_;
+  std::vector<std::unique_ptr<Edge>> edges_;
+  std::vector<Edge*> sources_;
+  std::vector<Edge*> sinks_;
+  bool closed_{false};
+  /// set on failure or destruction, aborts every blocking wait
+  std::atomic<bool> stop_{false};
+  std::mutex err_mtx_;
+  std::exception_ptr error_;
+};
+
+}  // namespace tk
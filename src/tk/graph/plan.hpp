@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "gsl/gsl-lite.hpp"
+#include "tk/graph/frozen.hpp"
+#include "tk/graph/fusion.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/util/int_def.h"
+
+namespace tk {
+
+/**
+ * @brief Immutable compiled form of a Graph, shared by any number of concurrent runs
+ *
+ * Holds everything a run needs that does not change between runs: the CSR topology, the
+ * fused chains, the initial pending-input count of every node, root units, sink nodes and
+ * a topological order. A run then only allocates its counters and output slots.
+ *
+ * @note The plan does not follow later changes of the source graph, compile it again
+ */
+class Plan {
+ public:
+  explicit Plan(const Graph& g) : graph_(g.freeze()), units_(graph_) {
+    u32_t n = static_cast<u32_t>(graph_.size());
+    in_degree_.reserve(n);
+    for (u32_t u = 0; u < n; ++u) {
+      in_degree_.push_back(graph_.inDegree(u));
+      if (graph_.outDegree(u) == 0) sinks_.push_back(u);
+    }
+    root_units_.reserve(graph_.roots().size());
+    for (u32_t r : graph_.roots()) root_units_.push_back(units_.unitOf(r));
+    order_.reserve(n);
+    for (Node* u : g.topoOrder()) order_.push_back(static_cast<u32_t>(u->id()));
+    height_.assign(n, 1);
+    for (auto it = order_.rbegin(); it != order_.rend(); ++it) {
+      for (u32_t v : graph_.successors(*it)) height_[*it] = std::max(height_[*it], height_[v] + 1);
+    }
+  }
+
+  const FrozenGraph& graph() const noexcept { return graph_; }
+  const FusedChains& units() const noexcept { return units_; }
+  size_t size() const noexcept { return graph_.size(); }
+
+  /// Initial pending-input count of every node, copied into PendingInputs by each run
+  gsl::span<const u32_t> inDegrees() const noexcept { return gsl::span<const u32_t>(in_degree_.data(), in_degree_.size()); }
+  /// Units holding a root node, each run starts by scheduling them
+  const std::vector<u32_t>& rootUnits() const noexcept { return root_units_; }
+  /// Nodes without downstream, in id order
+  const std::vector<u32_t>& sinks() const noexcept { return sinks_; }
+  /// Node ids in topological order
+  const std::vector<u32_t>& order() const noexcept { return order_; }
+  /// Number of nodes on the longest path from u to a sink, u included
+  u32_t height(u32_t u) const noexcept { return height_[u]; }
+
+ private:
+  FrozenGraph graph_;
+  FusedChains units_;
+  std::vector<u32_t> in_degree_;
+  std::vector<u32_t> root_units_;
+  std::vector<u32_t> sinks_;
+  std::vector<u32_t> order_;
+  std::vector<u32_t> height_;
+};
+
+}  // namespace tk
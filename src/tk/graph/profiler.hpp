@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "tk/graph/graph.hpp"
+#include "tk/util/clock.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/// One node execution
+struct ProfileEvent {
+  u32_t node;
+  u32_t thread;
+  /// nanoseconds since the profiler was created
+  i64_t start;
+  i64_t end;
+};
+
+/// Aggregated executions of one node
+struct NodeProfile {
+  u64_t count{0};
+  i64_t total_ns{0};
+  i64_t max_ns{0};
+};
+
+/// Longest path of the graph weighted by mean node duration
+struct CriticalPath {
+  std::vector<Node*> nodes;
+  double total_ns{0};
+};
+
+/**
+ * @brief Records per-node execution intervals of a GraphExecutor or Pipeline
+ *
+ * Every executing thread owns a ring buffer, so recording takes no lock; once a buffer is
+ * full the oldest events are overwritten. Results may only be read while no execution is in
+ * progress.
+ */
+class Profiler : private Noncopy {
+ public:
+  using clock = ::util::Clock;
+
+  /// @param events_per_thread Ring buffer capacity of each thread
+  explicit Profiler(size_t events_per_thread = 1 << 16)
+      : capacity_(std::max<size_t>(events_per_thread, 1)), epoch_(clock::now()) {}
+
+  /// Prepare ring buffers for thread indices [0, threads), called by executors
+  void attach(size_t threads) {
+    while (rings_.size() < threads) rings_.emplace_back(new Ring(capacity_));
+  }
+
+  void record(size_t thread, u32_t node, const clock::time_point& start, const clock::time_point& end) noexcept {
+    Ring& r = *rings_[thread];
+    r.events[r.next % capacity_] = {node, static_cast<u32_t>(thread), ns(start), ns(end)};
+    ++r.next;
+  }
+
+  /// All retained events, sorted by start time
+  std::vector<ProfileEvent> events() const {
+    std::vector<ProfileEvent> all;
+    for (auto& r : rings_) {
+      size_t n = std::min<size_t>(r->next, capacity_);
+      all.insert(all.end(), r->events.begin(), r->events.begin() + n);
+    }
+    std::sort(all.begin(), all.end(), [](const ProfileEvent& a, const ProfileEvent& b) { return a.start < b.start; });
+    return all;
+  }
+
+  /// Per-node aggregation of retained events, indexed by Node::id()
+  std::vector<NodeProfile> summary(size_t node_count) const {
+    std::vector<NodeProfile> s(node_count);
+    for (auto& r : rings_) {
+      size_t n = std::min<size_t>(r->next, capacity_);
+      for (size_t i = 0; i < n; ++i) {
+        const ProfileEvent& e = r->events[i];
+        if (e.node >= node_count) continue;
+        NodeProfile& p = s[e.node];
+        ++p.count;
+        p.total_ns += e.end - e.start;
+        p.max_ns = std::max(p.max_ns, e.end - e.start);
+      }
+    }
+    return s;
+  }
+
+  /**
+   * @brief Longest path through g where each node weighs its mean measured duration
+   *
+   * This is the lower bound of a run's latency however many workers are available.
+   */
+  CriticalPath criticalPath(const Graph& g) const {
+    std::vector<NodeProfile> s = summary(g.size());
+    std::vector<double> dist(g.size(), 0);
+    std::vector<Node*> prev(g.size(), nullptr);
+    CriticalPath path;
+    Node* last = nullptr;
+    for (Node* n : g.topoOrder()) {
+      double best = 0;
+      for (size_t i = 0; i < n->upSize(); ++i) {
+        Node* u = n->up(i);
+        if (!prev[n->id()] || dist[u->id()] > best) {
+          best = dist[u->id()];
+          prev[n->id()] = u;
+        }
+      }
+      const NodeProfile& p = s[n->id()];
+      dist[n->id()] = best + (p.count ? static_cast<double>(p.total_ns) / p.count : 0);
+      if (!last || dist[n->id()] > path.total_ns) {
+        path.total_ns = dist[n->id()];
+        last = n;
+      }
+    }
+    for (Node* n = last; n; n = prev[n->id()]) path.nodes.push_back(n);
+    std::reverse(path.nodes.begin(), path.nodes.end());
+    return path;
+  }
+
+  /// Write retained events in Chrome trace-event format (chrome://tracing, Perfetto)
+  void writeChromeTrace(std::ostream& os, const Graph& g) const {
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char num[64];
+    for (const ProfileEvent& e : events()) {
+      if (!first) os << ',';
+      first = false;
+      os << "{\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread << ",\"name\":\"";
+      writeEscaped(os, e.node < g.size() ? g.node(e.node)->name() : std::string_view("?"));
+      std::snprintf(num, sizeof(num), "\",\"ts\":%.3f,\"dur\":%.3f}", e.start / 1e3, (e.end - e.start) / 1e3);
+      os << num;
+    }
+    os << "]}";
+  }
+
+  /// Drop all events
+  void clear() noexcept {
+    for (auto& r : rings_) r->next = 0;
+  }
+
+ private:
+  struct alignas(64) Ring {
+    explicit Ring(size_t capacity) : events(capacity) {}
+    std::vector<ProfileEvent> events;
+    u64_t next{0};
+  };
+
+  i64_t ns(const clock::time_point& t) const noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t - epoch_).count();
+  }
+
+  static void writeEscaped(std::ostream& os, std::string_view s) {
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        os << '\\' << c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+        os << buf;
+      } else {
+        os << c;
+      }
+    }
+  }
+
+  size_t capacity_;
+  clock::time_point epoch_;
+  std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+}  // namespace tk
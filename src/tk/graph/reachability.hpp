@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tk/graph/frozen.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/**
+ * @brief Constant-time "is y downstream of x" queries over a Graph
+ *
+ * Two representations, both built in one pass in reverse topological order:
+ * - BITSET: one row of n bits per node, rows of successors are OR-ed word by word.
+ *   n^2 / 8 bytes, suited to graphs up to some ten thousand nodes.
+ * - CHAINS: nodes are covered by k disjoint paths (chains); every node keeps, per chain, the
+ *   earliest chain position it reaches. x reaches y when y's position in its chain is at or
+ *   after that entry. n * k * 4 bytes, small when the graph is narrow.
+ *
+ * The index observes its graph: Node::link patches it in place, Graph::addNode and
+ * Node::unlink mark it stale and the next query rebuilds it. A link walks up from its
+ * upstream node and updates only the ancestors that did not already reach the downstream
+ * node, at most O(ancestors x (n / 64)) for BITSET or O(ancestors x chains) for CHAINS.
+ *
+ * @note Not thread-safe while stale or while the graph changes: reachable() is const but
+ *       rebuilds a stale index in place
+ */
+class ReachabilityIndex : public GraphObserver, private Noncopy {
+ public:
+  enum class Mode {
+    /// BITSET when it fits in the memory budget, CHAINS otherwise
+    AUTO,
+    BITSET,
+    CHAINS
+  };
+
+  /**
+   * @param g Graph to index, must outlive the index
+   * @param mode Representation
+   * @param bitset_bytes Largest BITSET index built in AUTO mode
+   */
+  explicit ReachabilityIndex(Graph& g, Mode mode = Mode::AUTO, size_t bitset_bytes = 64 << 20)
+      : g_(g), requested_(mode), bitset_bytes_(bitset_bytes) {
+    g_.addObserver(this);
+    rebuild();
+  }
+  ~ReachabilityIndex() override { g_.removeObserver(this); }
+
+  /// Whether a path of at least one edge leads from x to y
+  bool reachable(const Node* x, const Node* y) const {
+    if (stale_) build();
+    return reach(static_cast<u32_t>(x->id()), static_cast<u32_t>(y->id()));
+  }
+
+  void rebuild() { build(); }
+
+  /// Representation in use, never AUTO
+  Mode mode() const noexcept { return mode_; }
+  /// Number of chains of the CHAINS representation
+  size_t chains() const noexcept { return chains_; }
+  bool stale() const noexcept { return stale_; }
+  size_t memoryBytes() const noexcept {
+    return rows_.capacity() * sizeof(u64_t) + (first_.capacity() + chain_.capacity() + pos_.capacity()) * sizeof(u32_t);
+  }
+
+  void onAddNode(Node*) override { stale_ = true; }
+  void onUnlink(Node*, Node*) override { stale_ = true; }
+  void onLink(Node* x, Node* y) override {
+    if (stale_) return;
+    u32_t ux = static_cast<u32_t>(x->id()), uy = static_cast<u32_t>(y->id());
+    // x and its ancestors now reach y and y's downstream; an ancestor that already reached y
+    // already reaches all of it, and so do its own ancestors
+    if (reach(ux, uy)) return;
+    if (++epoch_ == 0) {
+      std::fill(mark_.begin(), mark_.end(), 0);
+      epoch_ = 1;
+    }
+    affected_.clear();
+    affected_.push_back(ux);
+    mark_[ux] = epoch_;
+    for (size_t k = 0; k < affected_.size(); ++k) {
+      Node* v = g_.node(affected_[k]);
+      for (size_t j = 0; j < v->upSize(); ++j) {
+        u32_t u = static_cast<u32_t>(v->up(j)->id());
+        if (mark_[u] == epoch_ || reach(u, uy)) continue;
+        mark_[u] = epoch_;
+        affected_.push_back(u);
+      }
+    }
+    for (u32_t u : affected_) {
+      if (mode_ == Mode::BITSET) {
+        u64_t* row = &rows_[size_t(u) * words_];
+        const u64_t* from = &rows_[size_t(uy) * words_];
+        for (size_t w = 0; w < words_; ++w) row[w] |= from[w];
+        row[uy / 64] |= u64_t(1) << (uy % 64);
+      } else {
+        u32_t* row = &first_[size_t(u) * chains_];
+        const u32_t* from = &first_[size_t(uy) * chains_];
+        for (size_t c = 0; c < chains_; ++c) row[c] = std::min(row[c], from[c]);
+        row[chain_[uy]] = std::min(row[chain_[uy]], pos_[uy]);
+      }
+    }
+  }
+
+ private:
+  static constexpr u32_t kNone = ~u32_t(0);
+
+  bool reach(u32_t x, u32_t y) const noexcept {
+    if (mode_ == Mode::BITSET) return rows_[size_t(x) * words_ + y / 64] & (u64_t(1) << (y % 64));
+    // kNone exceeds every position
+    return pos_[y] >= first_[size_t(x) * chains_ + chain_[y]];
+  }
+
+  void build() const {
+    n_ = static_cast<u32_t>(g_.size());
+    mode_ = requested_;
+    if (mode_ == Mode::AUTO) {
+      size_t bytes = size_t(n_) * ((n_ + 63) / 64) * 8;
+      mode_ = bytes <= bitset_bytes_ ? Mode::BITSET : Mode::CHAINS;
+    }
+    FrozenGraph f = g_.freeze();
+    if (mode_ == Mode::BITSET) {
+      buildBitset(f);
+    } else {
+      buildChains(f);
+    }
+    mark_.assign(n_, 0);
+    epoch_ = 0;
+    stale_ = false;
+  }
+
+  void buildBitset(const FrozenGraph& f) const {
+    words_ = (n_ + 63) / 64;
+    rows_.assign(size_t(n_) * words_, 0);
+    first_.clear();
+    chain_.clear();
+    pos_.clear();
+    chains_ = 0;
+    const std::vector<Node*>& order = g_.topoOrder();
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      u32_t u = static_cast<u32_t>((*it)->id());
+      u64_t* row = &rows_[size_t(u) * words_];
+      for (u32_t v : f.successors(u)) {
+        const u64_t* from = &rows_[size_t(v) * words_];
+        for (size_t w = 0; w < words_; ++w) row[w] |= from[w];
+        row[v / 64] |= u64_t(1) << (v % 64);
+      }
+    }
+  }
+
+  void buildChains(const FrozenGraph& f) const {
+    rows_.clear();
+    words_ = 0;
+    const std::vector<Node*>& order = g_.topoOrder();
+    // greedy path cover: start a chain at every unassigned node, follow unassigned successors
+    chain_.assign(n_, kNone);
+    pos_.assign(n_, 0);
+    chains_ = 0;
+    for (Node* start : order) {
+      u32_t u = static_cast<u32_t>(start->id());
+      if (chain_[u] != kNone) continue;
+      u32_t c = static_cast<u32_t>(chains_++);
+      for (u32_t p = 0; u != kNone; ++p) {
+        chain_[u] = c;
+        pos_[u] = p;
+        u32_t next = kNone;
+        for (u32_t v : f.successors(u)) {
+          if (chain_[v] == kNone) {
+            next = v;
+            break;
+          }
+        }
+        u = next;
+      }
+    }
+    first_.assign(size_t(n_) * chains_, kNone);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+      u32_t u = static_cast<u32_t>((*it)->id());
+      u32_t* row = &first_[size_t(u) * chains_];
+      for (u32_t v : f.successors(u)) {
+        const u32_t* from = &first_[size_t(v) * chains_];
+        for (size_t c = 0; c < chains_; ++c) row[c] = std::min(row[c], from[c]);
+        row[chain_[v]] = std::min(row[chain_[v]], pos_[v]);
+      }
+    }
+  }
+
+  Graph& g_;
+  Mode requested_;
+  size_t bitset_bytes_;
+  // rebuilt lazily by reachable()
+  mutable Mode mode_{Mode::BITSET};
+  mutable bool stale_{true};
+  mutable u32_t n_{0};
+  /// BITSET: row of reachable node ids per node
+  mutable size_t words_{0};
+  mutable std::vector<u64_t> rows_;
+  /// CHAINS: earliest reachable position per node and chain, chain and position per node
+  mutable size_t chains_{0};
+  mutable std::vector<u32_t> first_;
+  mutable std::vector<u32_t> chain_;
+  mutable std::vector<u32_t> pos_;
+  /// onLink: ancestors to update, visit marks
+  std::vector<u32_t> affected_;
+  mutable std::vector<u32_t> mark_;
+  mutable u32_t epoch_{0};
+};
+
+}  // namespace tk
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "tk/graph/frozen.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/util/int_def.h"
+
+namespace tk {
+
+/**
+ * @brief Edges of g implied by another path between the same nodes
+ *
+ * u -> v is redundant when v is also reachable from another successor of u (A -> C when
+ * A -> B -> C exists). Reachability is kept as one bitset row per node over topological
+ * positions; when n x n bits exceed memory_bytes, columns are processed in windows so that
+ * memory stays within budget at the cost of one pass over the edges per window.
+ *
+ * @param g Graph to analyse
+ * @param memory_bytes Budget for reachability bitsets
+ * @return std::vector<std::pair<Node*, Node*>> Redundant (upstream, downstream) edges
+ */
+inline std::vector<std::pair<Node*, Node*>> redundantEdges(const Graph& g, size_t memory_bytes = 64 << 20) {
+  std::vector<std::pair<Node*, Node*>> redundant;
+  const std::vector<Node*>& order = g.topoOrder();
+  size_t n = order.size();
+  if (n == 0) return redundant;
+  FrozenGraph f = g.freeze();
+
+  // topological position of every node, successors sorted by it
+  std::vector<u32_t> pos(n);
+  for (size_t i = 0; i < n; ++i) pos[order[i]->id()] = static_cast<u32_t>(i);
+  std::vector<u32_t> succ_ofs(n + 1, 0), succ;
+  succ.reserve(f.edgeSize());
+  for (size_t i = 0; i < n; ++i) {
+    for (u32_t v : f.successors(static_cast<u32_t>(order[i]->id()))) succ.push_back(pos[v]);
+    std::sort(succ.begin() + succ_ofs[i], succ.end());
+    succ_ofs[i + 1] = static_cast<u32_t>(succ.size());
+  }
+
+  size_t words = std::max<size_t>(1, std::min((n + 63) / 64, memory_bytes / 8 / n));
+  std::vector<u64_t> reach(n * words);
+  std::vector<u64_t> acc(words);
+  for (size_t lo = 0; lo < n; lo += words * 64) {
+    size_t hi = std::min(n, lo + words * 64);
+    // rows at or after hi cannot reach the window, every row below is rebuilt
+    for (size_t u = hi; u-- > 0;) {
+      std::fill(acc.begin(), acc.end(), 0);
+      for (u32_t k = succ_ofs[u]; k < succ_ofs[u + 1]; ++k) {
+        u32_t v = succ[k];
+        if (v >= hi) break;
+        if (v >= lo) {
+          size_t bit = v - lo;
+          if (acc[bit / 64] & (u64_t(1) << (bit % 64))) {
+            redundant.emplace_back(order[u], order[v]);
+            continue;
+          }
+          acc[bit / 64] |= u64_t(1) << (bit % 64);
+        }
+        const u64_t* row = &reach[v * words];
+        for (size_t w = 0; w < words; ++w) acc[w] |= row[w];
+      }
+      std::copy(acc.begin(), acc.end(), reach.begin() + u * words);
+    }
+  }
+  return redundant;
+}
+
+/**
+ * @brief Unlink every redundant edge of g, see redundantEdges()
+ *
+ * Reachability and therefore execution order are preserved, but the downstream node of a
+ * removed edge no longer receives the upstream output as an input: only use this on edges
+ * that express ordering, or on nodes that ignore those inputs.
+ *
+ * @return size_t Number of edges removed
+ */
+inline size_t transitiveReduction(Graph& g, size_t memory_bytes = 64 << 20) {
+  size_t removed = 0;
+  for (auto& e : redundantEdges(g, memory_bytes)) removed += e.first->unlink(e.second);
+  return removed;
+}
+
+}  // namespace tk
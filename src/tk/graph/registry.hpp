@@ -0,0 +1,82 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+
+#include "tk/graph/graph.hpp"
+#include "tk/util/factory.hpp"
+#include "tk/util/scope.hpp"
+
+namespace tk {
+
+/**
+ * @brief Maps node types to string keys and back
+ *
+ * Lets a graph be rebuilt from a description holding only type keys and names, see
+ * tk/graph/serialize.hpp. tk::Node is registered as "tk::Node".
+ *
+ * Usage:
+ *
+ * NodeRegistry::global().registerNode<MyNode>("MyNode");
+ * // or, at namespace scope
+ * TK_REGISTER_NODE(MyNode, "MyNode");
+ */
+class NodeRegistry {
+ public:
+  /// Adds a node named by the second argument to the graph
+  using creator_t = std::function<Node*(Graph&, const std::string&)>;
+
+  static NodeRegistry& global() {
+    static NodeRegistry x;
+    return x;
+  }
+
+  /**
+   * @brief Register node type N under key
+   *
+   * @exception std::invalid_argument Key is already registered
+   * @param key Type key
+   * @param creator Creates an N in the graph, defaults to Graph::addNode<N>(name)
+   */
+  template <class N>
+  void registerNode(const std::string& key, creator_t creator = nullptr) {
+    static_assert(std::is_base_of<Node, N>::value, "N is not derived from tk::Node");
+    if (!creator) {
+      static_assert(std::is_constructible<N, const std::string&>::value,
+                    "N is not constructible from name only, provide a creator");
+      creator = [](Graph& g, const std::string& name) { return g.addNode<N>(name); };
+    }
+    factory_.Register(key, std::move(creator));
+    keys_.emplace(std::type_index(typeid(N)), key);
+  }
+
+  /// Key of the dynamic type of n, nullptr if that type is not registered
+  const std::string* keyOf(const Node& n) const {
+    auto it = keys_.find(std::type_index(typeid(n)));
+    return it == keys_.end() ? nullptr : &it->second;
+  }
+
+  bool contains(const std::string& key) const { return factory_.Has(key); }
+
+  /// Add a node of the type registered under key to g, nullptr if key is unknown
+  Node* create(const std::string& key, Graph& g, const std::string& name) const {
+    return factory_.Create(key, g, name);
+  }
+
+ private:
+  NodeRegistry() { registerNode<Node>("tk::Node"); }
+
+  ::util::FactoryBase<std::string, Node, Node*, Graph&, const std::string&> factory_;
+  std::unordered_map<std::type_index, std::string> keys_;
+};
+
+}  // namespace tk
+
+#define TK_REGISTER_NODE_CAT_(a, b) a##b
+#define TK_REGISTER_NODE_NAME_(line) TK_REGISTER_NODE_CAT_(tk_node_registor_, line)
+/// Register node type at static initialization
+#define TK_REGISTER_NODE(type, key) \
+  static ::tk::util::Register TK_REGISTER_NODE_NAME_(__LINE__)([]() { ::tk::NodeRegistry::global().registerNode<type>(key); })
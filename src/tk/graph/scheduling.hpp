@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include "tk/graph/plan.hpp"
+#include "tk/util/clock.hpp"
+#include "tk/util/int_def.h"
+
+namespace tk {
+
+/// What a SchedulingPolicy knows about the run a ready unit belongs to
+struct RunInfo {
+  ::util::Clock::time_point submitted;
+  /// time_point::max() when the run has no deadline
+  ::util::Clock::time_point deadline;
+};
+
+/**
+ * @brief Order in which GraphExecutor runs ready work
+ *
+ * Without a policy every worker runs the work it readied itself first, which is cheap but
+ * blind to urgency. With a policy all ready units of all runs wait in one shared queue and
+ * the unit of lowest rank runs next, ties in readiness order.
+ */
+class SchedulingPolicy {
+ public:
+  virtual ~SchedulingPolicy() = default;
+
+  /**
+   * @brief Rank of a ready unit, lower runs first
+   *
+   * @param plan Plan of the run
+   * @param unit Unit of Plan::units()
+   * @param run Run the unit belongs to
+   */
+  virtual i64_t rank(const Plan& plan, u32_t unit, const RunInfo& run) const = 0;
+};
+
+/// Longest remaining path first, so the work bounding a run's latency never waits
+class CriticalPathPolicy : public SchedulingPolicy {
+ public:
+  i64_t rank(const Plan& plan, u32_t unit, const RunInfo&) const override {
+    return -static_cast<i64_t>(plan.height(plan.units().head(unit)));
+  }
+};
+
+/// Earliest deadline first, then longest remaining path; runs without deadline go last
+class DeadlinePolicy : public SchedulingPolicy {
+ public:
+  i64_t rank(const Plan& plan, u32_t unit, const RunInfo& run) const override {
+    i64_t height = std::min<i64_t>(plan.height(plan.units().head(unit)), kPathScale - 1);
+    if (run.deadline == ::util::Clock::time_point::max()) return kNoDeadline - height;
+    // microseconds since the epoch leave room below for path length
+    i64_t us = std::chrono::duration_cast<std::chrono::microseconds>(run.deadline.time_since_epoch()).count();
+    return us * kPathScale - height;
+  }
+
+ private:
+  static constexpr i64_t kPathScale = 1024;
+  static constexpr i64_t kNoDeadline = std::numeric_limits<i64_t>::max() - (i64_t(1) << 32);
+};
+
+}  // namespace tk
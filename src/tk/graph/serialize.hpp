@@ -0,0 +1,257 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tk/graph/graph.hpp"
+#include "tk/graph/registry.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/*
+ * Binary graph topology file, all integers in host byte order:
+ *
+ *   FileHeader
+ *   TypeRecord[type_count]       type keys
+ *   NodeRecord[node_count]       nodes in topological order
+ *   u32_t[node_count + 1]        CSR offsets of upstream lists
+ *   u32_t[edge_count]            upstream node indices, in Node::up() order
+ *   char[string_bytes]           names and type keys
+ *
+ * Sections are 8 byte aligned. The loader maps the file and reads the arrays in place.
+ */
+namespace detail {
+
+constexpr char kGraphMagic[4] = {'T', 'K', 'G', 'R'};
+constexpr u32_t kGraphVersion = 1;
+constexpr u32_t kByteOrderMark = 0x01020304;
+
+struct FileHeader {
+  char magic[4];
+  u32_t version;
+  u32_t byte_order;
+  u32_t type_count;
+  u32_t node_count;
+  u32_t edge_count;
+  u64_t types_offset;
+  u64_t nodes_offset;
+  u64_t offsets_offset;
+  u64_t edges_offset;
+  u64_t strings_offset;
+  u64_t string_bytes;
+};
+
+struct TypeRecord {
+  u32_t key_offset;
+  u32_t key_size;
+};
+
+struct NodeRecord {
+  u32_t name_offset;
+  u32_t name_size;
+  u32_t type;
+  u32_t reserved;
+};
+
+inline u64_t align8(u64_t v) { return (v + 7) & ~u64_t(7); }
+
+/// Read-only memory mapping of a whole file
+class MappedFile : private Noncopy {
+ public:
+  explicit MappedFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open graph file: " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("cannot stat graph file: " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      throw std::runtime_error("cannot map graph file: " + path);
+    }
+  }
+  ~MappedFile() {
+    if (data_) ::munmap(data_, size_);
+  }
+  const char* data() const noexcept { return static_cast<const char*>(data_); }
+  size_t size() const noexcept { return size_; }
+
+ private:
+  void* data_{nullptr};
+  size_t size_{0};
+};
+
+}  // namespace detail
+
+/**
+ * @brief Write the topology of g to a binary file
+ *
+ * Only node names, type keys and edges are stored, node state is not.
+ *
+ * @exception std::invalid_argument A node type is not registered in NodeRegistry::global()
+ * @exception std::runtime_error Failed to write the file
+ */
+inline void saveGraph(const Graph& g, const std::string& path) {
+  using namespace detail;
+  const NodeRegistry& registry = NodeRegistry::global();
+  const std::vector<Node*>& order = g.topoOrder();
+  u32_t n = static_cast<u32_t>(order.size());
+
+  std::string strings;
+  std::vector<TypeRecord> types;
+  std::unordered_map<const std::string*, u32_t> type_index;
+  std::vector<NodeRecord> records(n);
+  std::vector<u32_t> pos(n);
+  std::vector<u32_t> offsets(n + 1, 0);
+  for (u32_t i = 0; i < n; ++i) pos[order[i]->id()] = i;
+
+  for (u32_t i = 0; i < n; ++i) {
+    Node* node = order[i];
+    const std::string* key = registry.keyOf(*node);
+    if (!key) throw std::invalid_argument("node type is not registered: " + std::string(node->name()));
+    auto it = type_index.find(key);
+    if (it == type_index.end()) {
+      it = type_index.emplace(key, static_cast<u32_t>(types.size())).first;
+      types.push_back({static_cast<u32_t>(strings.size()), static_cast<u32_t>(key->size())});
+      strings += *key;
+    }
+    records[i] = {static_cast<u32_t>(strings.size()), static_cast<u32_t>(node->name().size()), it->second, 0};
+    strings += node->name();
+    offsets[i + 1] = offsets[i] + static_cast<u32_t>(node->upSize());
+  }
+  std::vector<u32_t> edges;
+  edges.reserve(offsets[n]);
+  for (u32_t i = 0; i < n; ++i) {
+    Node* node = order[i];
+    for (size_t j = 0; j < node->upSize(); ++j) edges.push_back(pos[node->up(j)->id()]);
+  }
+
+  FileHeader h;
+  std::memcpy(h.magic, kGraphMagic, sizeof(h.magic));
+  h.version = kGraphVersion;
+  h.byte_order = kByteOrderMark;
+  h.type_count = static_cast<u32_t>(types.size());
+  h.node_count = n;
+  h.edge_count = static_cast<u32_t>(edges.size());
+  h.types_offset = align8(sizeof(FileHeader));
+  h.nodes_offset = align8(h.types_offset + types.size() * sizeof(TypeRecord));
+  h.offsets_offset = align8(h.nodes_offset + records.size() * sizeof(NodeRecord));
+  h.edges_offset = align8(h.offsets_offset + offsets.size() * sizeof(u32_t));
+  h.strings_offset = align8(h.edges_offset + edges.size() * sizeof(u32_t));
+  h.string_bytes = strings.size();
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) throw std::runtime_error("cannot create graph file: " + path);
+  auto section = [&out](u64_t offset, const void* data, size_t bytes) {
+    static const char zeros[8] = {0};
+    out.write(zeros, static_cast<std::streamsize>(offset - static_cast<u64_t>(out.tellp())));
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+  };
+  out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  section(h.types_offset, types.data(), types.size() * sizeof(TypeRecord));
+  section(h.nodes_offset, records.data(), records.size() * sizeof(NodeRecord));
+  section(h.offsets_offset, offsets.data(), offsets.size() * sizeof(u32_t));
+  section(h.edges_offset, edges.data(), edges.size() * sizeof(u32_t));
+  section(h.strings_offset, strings.data(), strings.size());
+  if (!out) throw std::runtime_error("failed to write graph file: " + path);
+}
+
+/**
+ * @brief Add the nodes and edges stored in a file written by saveGraph to g
+ *
+ * Nodes are created through NodeRegistry::global() in topological order, so every link is
+ * appended without reordering. Upstream order of every node is restored.
+ *
+ * The whole file is validated before the first node is created, so g is left unchanged when
+ * the file is rejected. If a node creator throws, the nodes created before it stay in g.
+ *
+ * @exception std::runtime_error File is missing, malformed, or refers to an unknown type key
+ * @return std::vector<Node*> Created nodes, in file order
+ */
+inline std::vector<Node*> loadGraph(const std::string& path, Graph& g) {
+  using namespace detail;
+  MappedFile file(path);
+  const char* base = file.data();
+  if (file.size() < sizeof(FileHeader)) throw std::runtime_error("truncated graph file: " + path);
+  FileHeader h;
+  std::memcpy(&h, base, sizeof(h));
+  if (std::memcmp(h.magic, kGraphMagic, sizeof(h.magic)) != 0 || h.version != kGraphVersion ||
+      h.byte_order != kByteOrderMark) {
+    throw std::runtime_error("not a compatible graph file: " + path);
+  }
+  // offsets come from the file: compare without adding, so nothing can wrap around
+  auto fits = [&file](u64_t offset, u64_t count, size_t size, size_t align) {
+    return offset <= file.size() && offset % align == 0 && count <= (file.size() - offset) / size;
+  };
+  if (!fits(h.types_offset, h.type_count, sizeof(TypeRecord), alignof(TypeRecord)) ||
+      !fits(h.nodes_offset, h.node_count, sizeof(NodeRecord), alignof(NodeRecord)) ||
+      !fits(h.offsets_offset, u64_t(h.node_count) + 1, sizeof(u32_t), alignof(u32_t)) ||
+      !fits(h.edges_offset, h.edge_count, sizeof(u32_t), alignof(u32_t)) ||
+      !fits(h.strings_offset, h.string_bytes, 1, 1)) {
+    throw std::runtime_error("truncated graph file: " + path);
+  }
+  // the mapping is page aligned, so aligned offsets give aligned pointers
+  auto types = reinterpret_cast<const TypeRecord*>(base + h.types_offset);
+  auto records = reinterpret_cast<const NodeRecord*>(base + h.nodes_offset);
+  auto offsets = reinterpret_cast<const u32_t*>(base + h.offsets_offset);
+  auto edges = reinterpret_cast<const u32_t*>(base + h.edges_offset);
+  const char* strings = base + h.strings_offset;
+  auto str = [strings](u32_t offset, u32_t size) { return std::string(strings + offset, size); };
+
+  const NodeRegistry& registry = NodeRegistry::global();
+  std::vector<std::string> keys;
+  keys.reserve(h.type_count);
+  for (u32_t t = 0; t < h.type_count; ++t) {
+    if (u64_t(types[t].key_offset) + types[t].key_size > h.string_bytes) {
+      throw std::runtime_error("corrupted graph file: " + path);
+    }
+    keys.push_back(str(types[t].key_offset, types[t].key_size));
+    if (!registry.contains(keys.back())) throw std::runtime_error("unknown node type: " + keys.back());
+  }
+  // upstream nodes precede their downstream nodes and appear once, so every link succeeds
+  std::vector<u32_t> seen(h.node_count, 0);
+  for (u32_t i = 0; i < h.node_count; ++i) {
+    const NodeRecord& r = records[i];
+    if (r.type >= h.type_count || u64_t(r.name_offset) + r.name_size > h.string_bytes ||
+        offsets[i + 1] < offsets[i] || offsets[i + 1] > h.edge_count) {
+      throw std::runtime_error("corrupted graph file: " + path);
+    }
+    for (u32_t e = offsets[i]; e < offsets[i + 1]; ++e) {
+      if (edges[e] >= i || seen[edges[e]] == i + 1) throw std::runtime_error("corrupted graph file: " + path);
+      seen[edges[e]] = i + 1;
+    }
+  }
+
+  std::vector<Node*> nodes;
+  nodes.reserve(h.node_count);
+  g.reserve(g.size() + h.node_count);
+  for (u32_t i = 0; i < h.node_count; ++i) {
+    const NodeRecord& r = records[i];
+    Node* node = registry.create(keys[r.type], g, str(r.name_offset, r.name_size));
+    if (!node) throw std::runtime_error("unknown node type: " + keys[r.type]);
+    nodes.push_back(node);
+  }
+  for (u32_t i = 0; i < h.node_count; ++i) {
+    for (u32_t e = offsets[i]; e < offsets[i + 1]; ++e) nodes[edges[e]]->link(nodes[i]);
+  }
+  return nodes;
+}
+
+}  // namespace tk
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "tk/util/crtp.hh"
+
+namespace tk {
+
+/**
+ * @brief Base of nodes of a StaticGraph
+ *
+ * Derived provides process() taking the outputs of its upstream nodes, in edge order, or
+ * the graph input for root nodes. Calls go through util::crtp, not a vtable, so they can be
+ * inlined.
+ *
+ * Usage:
+ *
+ * struct Twice : StaticNode<Twice> {
+ *   int process(int x) { return 2 * x; }
+ * };
+ */
+template <class Derived>
+class StaticNode : public util::crtp<Derived, StaticNode> {
+ public:
+  template <class... In>
+  decltype(auto) operator()(In&&... in) {
+    return this->underlying().process(std::forward<In>(in)...);
+  }
+};
+
+/// Edge from node From to node To, indices into the node list of a StaticGraph
+template <size_t From, size_t To>
+struct StaticEdge {
+  static constexpr size_t from = From;
+  static constexpr size_t to = To;
+};
+
+/// List of StaticEdge
+template <class... Edges>
+struct StaticEdges {
+  static constexpr size_t size = sizeof...(Edges);
+  static constexpr std::array<size_t, sizeof...(Edges)> from{Edges::from...};
+  static constexpr std::array<size_t, sizeof...(Edges)> to{Edges::to...};
+};
+
+namespace detail {
+
+/// Compile-time topology queries over a StaticEdges list of a graph of N nodes
+template <class Edges, size_t N>
+struct StaticTopology {
+  static constexpr bool edgesInRange() {
+    for (size_t e = 0; e < Edges::size; ++e) {
+      if (Edges::from[e] >= N || Edges::to[e] >= N) return false;
+    }
+    return true;
+  }
+
+  static constexpr size_t inDegree(size_t v) {
+    size_t d = 0;
+    for (size_t e = 0; e < Edges::size; ++e) d += Edges::to[e] == v;
+    return d;
+  }
+
+  static constexpr size_t outDegree(size_t v) {
+    size_t d = 0;
+    for (size_t e = 0; e < Edges::size; ++e) d += Edges::from[e] == v;
+    return d;
+  }
+
+  /// K-th predecessor of v in edge order
+  static constexpr size_t pred(size_t v, size_t k) {
+    for (size_t e = 0; e < Edges::size; ++e) {
+      if (Edges::to[e] == v && k-- == 0) return Edges::from[e];
+    }
+    return N;
+  }
+
+  struct Schedule {
+    std::array<size_t, N> order{};
+    size_t count{0};
+  };
+
+  /// Kahn's algorithm, nodes left out of the order are on a cycle
+  static constexpr Schedule schedule() {
+    Schedule s;
+    std::array<size_t, N> pending{};
+    for (size_t v = 0; v < N; ++v) {
+      pending[v] = inDegree(v);
+      if (pending[v] == 0) s.order[s.count++] = v;
+    }
+    for (size_t i = 0; i < s.count; ++i) {
+      for (size_t e = 0; e < Edges::size; ++e) {
+        if (Edges::from[e] == s.order[i] && --pending[Edges::to[e]] == 0) s.order[s.count++] = Edges::to[e];
+      }
+    }
+    return s;
+  }
+
+  static constexpr size_t sinkCount() {
+    size_t c = 0;
+    for (size_t v = 0; v < N; ++v) c += outDegree(v) == 0;
+    return c;
+  }
+
+  template <size_t Count>
+  static constexpr std::array<size_t, Count> sinks() {
+    std::array<size_t, Count> s{};
+    size_t i = 0;
+    for (size_t v = 0; v < N; ++v) {
+      if (outDegree(v) == 0) s[i++] = v;
+    }
+    return s;
+  }
+};
+
+}  // namespace detail
+
+/**
+ * @brief Graph whose topology is fixed at compile time
+ *
+ * Nodes are types, edges a type list. The schedule is a topological order computed at
+ * compile time, a cycle or an out of range edge fails to compile, and run() expands to a
+ * straight sequence of calls storing every output in a tuple. Predecessors of a node feed
+ * its process() in the order of their edges.
+ *
+ * Usage:
+ *
+ * StaticGraph<StaticEdges<StaticEdge<0, 1>, StaticEdge<0, 2>, StaticEdge<1, 3>, StaticEdge<2, 3>>,
+ *             Source, Left, Right, Join> g;
+ * auto [out] = g.run(input);  // one element per sink node, in node order
+ *
+ * @tparam Edges StaticEdges listing every edge
+ * @tparam Nodes Node types, each derived from StaticNode<Node>
+ */
+template <class Edges, class... Nodes>
+class StaticGraph {
+ public:
+  static constexpr size_t kSize = sizeof...(Nodes);
+
+ private:
+  using topo = detail::StaticTopology<Edges, sizeof...(Nodes)>;
+  static_assert(kSize > 0, "static graph has no node");
+  static_assert((std::is_base_of<StaticNode<Nodes>, Nodes>::value && ...), "node is not derived from StaticNode");
+  static_assert(topo::edgesInRange(), "static graph edge refers to a missing node");
+  static constexpr typename topo::Schedule kSchedule = topo::schedule();
+  static_assert(kSchedule.count == kSize, "static graph has a cycle");
+  static constexpr auto kSinks = topo::template sinks<topo::sinkCount()>();
+
+  template <size_t V, class Seq = std::make_index_sequence<topo::inDegree(V)>>
+  struct Preds;
+  template <size_t V, size_t... K>
+  struct Preds<V, std::index_sequence<K...>> {
+    using type = std::index_sequence<topo::pred(V, K)...>;
+  };
+
+  template <size_t V>
+  using node_t = std::tuple_element_t<V, std::tuple<Nodes...>>;
+
+  template <class In, size_t V, class P = typename Preds<V>::type>
+  struct Output;
+  template <class In, size_t V>
+  struct Output<In, V, std::index_sequence<>> {
+    using type = std::decay_t<decltype(std::declval<node_t<V>&>()(std::declval<const In&>()))>;
+  };
+  template <class In, size_t V, size_t... P>
+  struct Output<In, V, std::index_sequence<P...>> {
+    using type = std::decay_t<decltype(std::declval<node_t<V>&>()(std::declval<const typename Output<In, P>::type&>()...))>;
+  };
+
+  template <class In, class Seq = std::make_index_sequence<kSize>>
+  struct Values;
+  template <class In, size_t... V>
+  struct Values<In, std::index_sequence<V...>> {
+    using type = std::tuple<std::optional<typename Output<In, V>::type>...>;
+  };
+
+ public:
+  template <class In>
+  using values_t = typename Values<In>::type;
+  /// Result of run(), outputs of sink nodes in node order
+  template <class In, class Seq = std::make_index_sequence<kSinks.size()>>
+  struct Result;
+  template <class In, size_t... S>
+  struct Result<In, std::index_sequence<S...>> {
+    using type = std::tuple<typename Output<In, kSinks[S]>::type...>;
+  };
+  template <class In>
+  using result_t = typename Result<In>::type;
+
+  StaticGraph() = default;
+  explicit StaticGraph(Nodes... nodes) : nodes_(std::move(nodes)...) {}
+
+  template <size_t V>
+  node_t<V>& node() noexcept {
+    return std::get<V>(nodes_);
+  }
+
+  /// Node indices in execution order
+  static constexpr const std::array<size_t, kSize>& order() noexcept { return kSchedule.order; }
+
+  /**
+   * @brief Run every node once
+   *
+   * @param input Input of root nodes
+   * @return result_t<In> Outputs of sink nodes, in node order
+   */
+  template <class In>
+  result_t<In> run(const In& input) {
+    values_t<In> values;
+    runOrder(input, values, std::make_index_sequence<kSize>());
+    return collect<In>(values, std::make_index_sequence<kSinks.size()>());
+  }
+
+ private:
+  template <class In, size_t... I>
+  void runOrder(const In& input, values_t<In>& values, std::index_sequence<I...>) {
+    (step<kSchedule.order[I]>(input, values, typename Preds<kSchedule.order[I]>::type()), ...);
+  }
+
+  template <size_t V, class In, size_t... P>
+  void step(const In& input, values_t<In>& values, std::index_sequence<P...>) {
+    if constexpr (sizeof...(P) == 0) {
+      std::get<V>(values).emplace(std::get<V>(nodes_)(input));
+    } else {
+      std::get<V>(values).emplace(std::get<V>(nodes_)(static_cast<const typename Output<In, P>::type&>(*std::get<P>(values))...));
+    }
+  }
+
+  template <class In, size_t... S>
+  static result_t<In> collect(values_t<In>& values, std::index_sequence<S...>) {
+    return result_t<In>(std::move(*std::get<kSinks[S]>(values))...);
+  }
+
+  std::tuple<Nodes...> nodes_;
+};
+
+}  // namespace tk
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+#include "tk/util/clock.hpp"
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+
+/// Counters of one node, see GraphStats
+struct NodeStats {
+  u64_t count{0};
+  u64_t total_ns{0};
+  u64_t max_ns{0};
+  /// input queue depth summed over every sample, Pipeline only
+  u64_t depth_sum{0};
+  u64_t depth_max{0};
+  u64_t depth_samples{0};
+
+  double meanNs() const noexcept { return count ? static_cast<double>(total_ns) / count : 0; }
+  double meanDepth() const noexcept { return depth_samples ? static_cast<double>(depth_sum) / depth_samples : 0; }
+};
+
+/**
+ * @brief Always-on aggregated execution counters per node
+ *
+ * Unlike Profiler it keeps no event history, only relaxed atomic counters per node, cheap
+ * enough to leave attached in production. Executors skip all timing when no GraphStats is
+ * attached. Node ids beyond the size given at construction are ignored.
+ */
+class GraphStats : private Noncopy {
+ public:
+  using clock = ::util::Clock;
+
+  explicit GraphStats(size_t node_count) : size_(node_count), nodes_(new Counters[node_count]) {}
+
+  /// items processed by node between start and end
+  void record(u32_t node, const clock::time_point& start, const clock::time_point& end, u64_t items = 1) noexcept {
+    if (node >= size_) return;
+    Counters& c = nodes_[node];
+    u64_t ns = static_cast<u64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    c.count.fetch_add(items, std::memory_order_relaxed);
+    c.total_ns.fetch_add(ns, std::memory_order_relaxed);
+    atomicMax(c.max_ns, ns);
+  }
+
+  /// Items waiting at node's inputs
+  void recordDepth(u32_t node, u64_t depth) noexcept {
+    if (node >= size_) return;
+    Counters& c = nodes_[node];
+    c.depth_sum.fetch_add(depth, std::memory_order_relaxed);
+    c.depth_samples.fetch_add(1, std::memory_order_relaxed);
+    atomicMax(c.depth_max, depth);
+  }
+
+  NodeStats get(u32_t node) const noexcept {
+    const Counters& c = nodes_[node];
+    NodeStats s;
+    s.count = c.count.load(std::memory_order_relaxed);
+    s.total_ns = c.total_ns.load(std::memory_order_relaxed);
+    s.max_ns = c.max_ns.load(std::memory_order_relaxed);
+    s.depth_sum = c.depth_sum.load(std::memory_order_relaxed);
+    s.depth_max = c.depth_max.load(std::memory_order_relaxed);
+    s.depth_samples = c.depth_samples.load(std::memory_order_relaxed);
+    return s;
+  }
+
+  size_t size() const noexcept { return size_; }
+
+  void reset() noexcept {
+    for (size_t i = 0; i < size_; ++i) {
+      Counters& c = nodes_[i];
+      for (auto* a : {&c.count, &c.total_ns, &c.max_ns, &c.depth_sum, &c.depth_max, &c.depth_samples}) {
+        a->store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+ private:
+  struct alignas(64) Counters {
+    std::atomic<u64_t> count{0};
+    std::atomic<u64_t> total_ns{0};
+    std::atomic<u64_t> max_ns{0};
+    std::atomic<u64_t> depth_sum{0};
+    std::atomic<u64_t> depth_max{0};
+    std::atomic<u64_t> depth_samples{0};
+  };
+
+  static void atomicMax(std::atomic<u64_t>& a, u64_t v) noexcept {
+    u64_t cur = a.load(std::memory_order_relaxed);
+    while (cur < v && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+    }
+  }
+
+  size_t size_;
+  std::unique_ptr<Counters[]> nodes_;
+};
+
+}  // namespace tk
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+namespace util {
+
+/**
+ * @brief Fixed-size bitset any thread may set bits of concurrently
+ *
+ * Bits live in 64-bit atomic words with relaxed ordering; publish results through a
+ * synchronizing operation (thread join, barrier) before reading them from another thread.
+ */
+class AtomicBitset : private Noncopy {
+ public:
+  static constexpr size_t kWordBits = 64;
+
+  AtomicBitset() = default;
+  explicit AtomicBitset(size_t bits) { resize(bits); }
+
+  /// Resize to bits, clearing every bit
+  void resize(size_t bits) {
+    size_t words = (bits + kWordBits - 1) / kWordBits;
+    if (words != words_) {
+      words_ = words;
+      data_.reset(new std::atomic<u64_t>[words_]);
+    }
+    bits_ = bits;
+    clear();
+  }
+
+  void clear() noexcept {
+    for (size_t i = 0; i < words_; ++i) data_[i].store(0, std::memory_order_relaxed);
+  }
+
+  bool test(size_t i) const noexcept {
+    return data_[i / kWordBits].load(std::memory_order_relaxed) & bit(i);
+  }
+
+  /// @retval true The bit was clear before, i.e. this call won the race to set it
+  bool set(size_t i) noexcept {
+    return !(data_[i / kWordBits].fetch_or(bit(i), std::memory_order_relaxed) & bit(i));
+  }
+
+  u64_t word(size_t w) const noexcept { return data_[w].load(std::memory_order_relaxed); }
+  void storeWord(size_t w, u64_t v) noexcept { data_[w].store(v, std::memory_order_relaxed); }
+  void orWord(size_t w, u64_t v) noexcept { data_[w].fetch_or(v, std::memory_order_relaxed); }
+
+  /// Mask of the bits of word w that are inside the bitset
+  u64_t validMask(size_t w) const noexcept {
+    size_t rest = bits_ - w * kWordBits;
+    return rest >= kWordBits ? ~u64_t(0) : (u64_t(1) << rest) - 1;
+  }
+
+  void swap(AtomicBitset& other) noexcept {
+    data_.swap(other.data_);
+    std::swap(words_, other.words_);
+    std::swap(bits_, other.bits_);
+  }
+
+  size_t size() const noexcept { return bits_; }
+  size_t words() const noexcept { return words_; }
+
+  size_t count() const noexcept {
+    size_t c = 0;
+    for (size_t i = 0; i < words_; ++i) c += __builtin_popcountll(word(i));
+    return c;
+  }
+
+ private:
+  static u64_t bit(size_t i) noexcept { return u64_t(1) << (i % kWordBits); }
+
+  std::unique_ptr<std::atomic<u64_t>[]> data_;
+  size_t words_{0};
+  size_t bits_{0};
+};
+
+}  // namespace util
+}  // namespace tk
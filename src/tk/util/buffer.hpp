@@ -0,0 +1,210 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+namespace util {
+
+class BufferPool;
+
+/**
+ * @brief Refcounted byte buffer taken from a BufferPool
+ *
+ * Copying a Buffer shares the bytes instead of duplicating them, so a Packet fanned out to
+ * several nodes holds one allocation. Like cow_ptr, get() gives write access and detaches
+ * first when the bytes are shared, get_const() never copies. The memory goes back to its
+ * pool when the last Buffer referring to it is destroyed.
+ */
+class Buffer {
+ public:
+  Buffer() noexcept = default;
+  Buffer(const Buffer& other) noexcept : block_(other.block_) { retain(); }
+  Buffer(Buffer&& other) noexcept : block_(other.block_) { other.block_ = nullptr; }
+  ~Buffer() { release(); }
+
+  Buffer& operator=(const Buffer& other) noexcept {
+    if (other.block_ != block_) {
+      release();
+      block_ = other.block_;
+      retain();
+    }
+    return *this;
+  }
+  Buffer& operator=(Buffer&& other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  /// Writable bytes, copied into a new buffer from the same pool first if shared
+  inline u8_t* get();
+  const u8_t* get() const noexcept { return get_const(); }
+  const u8_t* get_const() const noexcept { return block_ ? block_->bytes() : nullptr; }
+
+  size_t size() const noexcept { return block_ ? block_->size : 0; }
+  /// Bytes usable without reallocation
+  size_t capacity() const noexcept { return block_ ? block_->capacity : 0; }
+  /// Number of Buffers sharing the bytes
+  u32_t useCount() const noexcept { return block_ ? block_->refs.load(std::memory_order_relaxed) : 0; }
+  bool unique() const noexcept { return useCount() == 1; }
+
+  explicit operator bool() const noexcept { return block_ != nullptr; }
+  bool operator==(const Buffer& other) const noexcept { return block_ == other.block_; }
+  bool operator!=(const Buffer& other) const noexcept { return block_ != other.block_; }
+
+  void swap(Buffer& other) noexcept { std::swap(block_, other.block_); }
+
+ private:
+  friend class BufferPool;
+
+  /// header in front of the bytes, keeps them aligned as malloc would
+  struct alignas(std::max_align_t) Block {
+    std::atomic<u32_t> refs{1};
+    u32_t size_class;
+    size_t size;
+    size_t capacity;
+    BufferPool* pool;
+    u8_t* bytes() noexcept { return reinterpret_cast<u8_t*>(this + 1); }
+  };
+
+  explicit Buffer(Block* b) noexcept : block_(b) {}
+
+  void retain() noexcept {
+    if (block_) block_->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  inline void release() noexcept;
+
+  Block* block_{nullptr};
+};
+
+/**
+ * @brief Size-class pool of Buffer memory
+ *
+ * Requests are rounded up to a power of two from 64 bytes, each class keeps a bounded list of
+ * released blocks so steady-state traffic allocates nothing. Requests above the largest class
+ * are served by the heap directly.
+ *
+ * @note The pool must outlive every Buffer taken from it
+ */
+class BufferPool : private Noncopy {
+ public:
+  static constexpr size_t kMinBytes = 64;
+  static constexpr u32_t kClasses = 21;  // 64 B .. 64 MiB
+
+  /// @param max_free_per_class Released blocks kept per size class
+  explicit BufferPool(size_t max_free_per_class = 64) : max_free_(max_free_per_class) {
+    // recycling must not allocate
+    for (auto& c : classes_) c.free.reserve(max_free_);
+  }
+
+  ~BufferPool() {
+    for (auto& c : classes_) {
+      for (Buffer::Block* b : c.free) std::free(b);
+    }
+  }
+
+  /// Process-wide pool
+  static BufferPool& global() {
+    static BufferPool x;
+    return x;
+  }
+
+  /// Uninitialized buffer of size bytes
+  Buffer allocate(size_t size) {
+    u32_t k = sizeClass(size);
+    Buffer::Block* b = nullptr;
+    if (k < kClasses) {
+      SizeClass& c = classes_[k];
+      std::lock_guard<std::mutex> lk(c.mtx);
+      if (!c.free.empty()) {
+        b = c.free.back();
+        c.free.pop_back();
+      }
+    }
+    if (b) {
+      b->refs.store(1, std::memory_order_relaxed);
+      reused_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      size_t capacity = k < kClasses ? kMinBytes << k : size;
+      void* mem = std::malloc(sizeof(Buffer::Block) + capacity);
+      if (!mem) throw std::bad_alloc();
+      b = new (mem) Buffer::Block;
+      b->size_class = k;
+      b->capacity = capacity;
+      b->pool = this;
+      allocated_.fetch_add(1, std::memory_order_relaxed);
+    }
+    b->size = size;
+    return Buffer(b);
+  }
+
+  /// Buffer holding a copy of size bytes at data
+  Buffer copyOf(const void* data, size_t size) {
+    Buffer buf = allocate(size);
+    if (size) std::memcpy(buf.block_->bytes(), data, size);
+    return buf;
+  }
+
+  /// Blocks obtained from the heap
+  u64_t allocated() const noexcept { return allocated_.load(std::memory_order_relaxed); }
+  /// Allocations served from released blocks
+  u64_t reused() const noexcept { return reused_.load(std::memory_order_relaxed); }
+
+ private:
+  friend class Buffer;
+
+  struct alignas(64) SizeClass {
+    std::mutex mtx;
+    std::vector<Buffer::Block*> free;
+  };
+
+  static u32_t sizeClass(size_t size) noexcept {
+    u32_t k = 0;
+    while (k < kClasses && (kMinBytes << k) < size) ++k;
+    return k;
+  }
+
+  void recycle(Buffer::Block* b) noexcept {
+    if (b->size_class < kClasses) {
+      SizeClass& c = classes_[b->size_class];
+      std::lock_guard<std::mutex> lk(c.mtx);
+      if (c.free.size() < max_free_) {
+        c.free.push_back(b);
+        return;
+      }
+    }
+    std::free(b);
+  }
+
+  size_t max_free_;
+  SizeClass classes_[kClasses];
+  std::atomic<u64_t> allocated_{0};
+  std::atomic<u64_t> reused_{0};
+};
+
+inline u8_t* Buffer::get() {
+  if (!block_) return nullptr;
+  if (block_->refs.load(std::memory_order_acquire) != 1) {
+    Buffer copy = block_->pool->copyOf(block_->bytes(), block_->size);
+    swap(copy);
+  }
+  return block_->bytes();
+}
+
+inline void Buffer::release() noexcept {
+  if (block_ && block_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) block_->pool->recycle(block_);
+  block_ = nullptr;
+}
+
+}  // namespace util
+}  // namespace tk
@@ -1,8 +1,12 @@
+#pragma once
+
 #include <functional>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace util {
 
@@ -28,15 +32,21 @@ static constexpr bool is_std_hashable_v = is_std_hashable<T>::value;
  * Factory<Foo>::Global().Register("bar", [] -> std::unique_ptr<Foo> { ... });
  * // Retrive a creator.
  * auto foo_instance = Factory<Foo>::Global().Create("bar");
+ *
+ * Creators may take arguments, listed after ObjectTypePtr:
+ *
+ * FactoryBase<std::string, Foo, Foo*, int>::Global().Register("baz", [](int v) -> Foo* { ... });
+ * auto baz_instance = FactoryBase<std::string, Foo, Foo*, int>::Global().Create("baz", 42);
  */
-template <typename KeyType, typename ObjectType, typename ObjectTypePtr = std::unique_ptr<ObjectType>>
+template <typename KeyType, typename ObjectType, typename ObjectTypePtr = std::unique_ptr<ObjectType>,
+          typename... CreatorArgs>
 class FactoryBase {
  public:
   static_assert(is_std_hashable_v<KeyType>, "KeyType of Factory is not hashable");
   using key_t = KeyType;
   using obj_t = ObjectType;
   using obj_ptr_t = ObjectTypePtr;
-  using creator_t = std::function<obj_ptr_t()>;
+  using creator_t = std::function<obj_ptr_t(CreatorArgs...)>;
 
   static FactoryBase& Global() {
     // FIXME(dmh): local static life cycle
@@ -49,12 +59,15 @@ class FactoryBase {
     creators_.emplace(key, std::move(creator));
   }
 
-  obj_ptr_t Create(const key_t& key) const {
+  template <typename... Args>
+  obj_ptr_t Create(const key_t& key, Args&&... args) const {
     auto it = creators_.find(key);
     if (it == creators_.cend()) return nullptr;
-    return obj_ptr_t(it->second());
+    return obj_ptr_t(it->second(std::forward<Args>(args)...));
   }
 
+  bool Has(const key_t& key) const { return creators_.find(key) != creators_.cend(); }
+
   std::vector<key_t> Keys() const {
     std::vector<key_t> keys;
     keys.reserve(creators_.size());
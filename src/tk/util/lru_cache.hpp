@@ -0,0 +1,131 @@
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+namespace util {
+
+/**
+ * @brief Bounded least-recently-used cache safe for concurrent use
+ *
+ * Keys are spread over independently locked shards, each evicting its own least recently
+ * used entry once full, so threads touching different keys rarely contend.
+ *
+ * @tparam K Key type
+ * @tparam V Value type, copied out on hits
+ * @tparam Hash Hash of K
+ */
+template <typename K, typename V, typename Hash = std::hash<K>>
+class ConcurrentLru : private Noncopy {
+ public:
+  /**
+   * @param capacity Maximum number of entries, split evenly over the shards
+   * @param shards Number of shards, rounded up to a power of two
+   */
+  explicit ConcurrentLru(size_t capacity, size_t shards = 16) {
+    size_t n = 1;
+    while (n < shards) n <<= 1;
+    if (n > capacity) n = 1;
+    mask_ = n - 1;
+    shards_.reserve(n);
+    for (size_t i = 0; i < n; ++i) shards_.emplace_back(new Shard((capacity + n - 1) / n));
+  }
+
+  /// Copy the value of key to out and make it the most recently used, false if absent
+  bool get(const K& key, V& out) {
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> lk(s.mtx);
+    auto it = s.index.find(key);
+    if (it == s.index.end()) {
+      ++s.misses;
+      return false;
+    }
+    s.entries.splice(s.entries.begin(), s.entries, it->second);
+    out = it->second->second;
+    ++s.hits;
+    return true;
+  }
+
+  /// Insert or replace the value of key, evicting the least recently used entry when full
+  void put(const K& key, V value) {
+    Shard& s = shard(key);
+    std::lock_guard<std::mutex> lk(s.mtx);
+    auto it = s.index.find(key);
+    if (it != s.index.end()) {
+      it->second->second = std::move(value);
+      s.entries.splice(s.entries.begin(), s.entries, it->second);
+      return;
+    }
+    if (s.index.size() >= s.capacity) {
+      s.index.erase(s.entries.back().first);
+      s.entries.pop_back();
+      ++s.evictions;
+    }
+    s.entries.emplace_front(key, std::move(value));
+    s.index.emplace(key, s.entries.begin());
+  }
+
+  void clear() {
+    for (auto& s : shards_) {
+      std::lock_guard<std::mutex> lk(s->mtx);
+      s->index.clear();
+      s->entries.clear();
+    }
+  }
+
+  size_t size() const {
+    size_t n = 0;
+    for (auto& s : shards_) {
+      std::lock_guard<std::mutex> lk(s->mtx);
+      n += s->index.size();
+    }
+    return n;
+  }
+
+  u64_t hits() const { return sum(&Shard::hits); }
+  u64_t misses() const { return sum(&Shard::misses); }
+  u64_t evictions() const { return sum(&Shard::evictions); }
+
+ private:
+  struct alignas(64) Shard {
+    explicit Shard(size_t cap) : capacity(cap ? cap : 1) {}
+    mutable std::mutex mtx;
+    size_t capacity;
+    /// most recently used first
+    std::list<std::pair<K, V>> entries;
+    std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator, Hash> index;
+    u64_t hits{0};
+    u64_t misses{0};
+    u64_t evictions{0};
+  };
+
+  u64_t sum(u64_t Shard::*counter) const {
+    u64_t n = 0;
+    for (auto& s : shards_) {
+      std::lock_guard<std::mutex> lk(s->mtx);
+      n += (*s).*counter;
+    }
+    return n;
+  }
+
+  Shard& shard(const K& key) {
+    // high bits, the shard's own table indexes with the low ones
+    u64_t h = static_cast<u64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ull;
+    return *shards_[(h >> 40) & mask_];
+  }
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  size_t mask_{0};
+};
+
+}  // namespace util
+}  // namespace tk
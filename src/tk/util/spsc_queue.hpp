@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <vector>
+
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+namespace util {
+
+/**
+ * @brief Bounded lock-free single-producer single-consumer ring buffer
+ *
+ * Each side caches the other side's index, so the shared cache lines are touched only when
+ * the queue looks full (producer) or empty (consumer).
+ *
+ * @tparam T Element type, must be default constructible and movable
+ */
+template <typename T>
+class SpscQueue : private Noncopy {
+ public:
+  /// @param capacity Maximum number of elements, rounded up to a power of two
+  explicit SpscQueue(size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+    slots_.resize(cap);
+    mask_ = cap - 1;
+  }
+
+  /// Producer only, the element is consumed only on success
+  template <typename U>
+  bool tryPush(U&& v) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_) return false;
+    }
+    slots_[tail & mask_] = std::forward<U>(v);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Consumer only
+  bool tryPop(T& out) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+    out = std::move(slots_[head & mask_]);
+    slots_[head & mask_] = T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Approximate number of elements, callable from any thread
+  size_t size() const noexcept {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+  size_t capacity() const noexcept { return mask_ + 1; }
+
+ private:
+  std::vector<T> slots_;
+  size_t mask_{0};
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t tail_cache_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t head_cache_{0};
+};
+
+}  // namespace util
+}  // namespace tk
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+namespace util {
+
+/**
+ * @brief Interned string table
+ *
+ * Every distinct string is stored once, packed back to back in large chunks, and gets a
+ * dense stable id. Views returned by view() stay valid for the lifetime of the pool.
+ * Lookup goes through an open addressing table of ids, no per-string allocation is made.
+ */
+class StringPool : private Noncopy {
+ public:
+  static constexpr u32_t npos = ~u32_t(0);
+
+  /// @param chunk_bytes Size of each character chunk, longer strings get a chunk of their own
+  explicit StringPool(size_t chunk_bytes = 64 << 10) : chunk_bytes_(chunk_bytes) {}
+
+  /// Id of s, adding it if absent
+  u32_t intern(std::string_view s) {
+    if (2 * (strings_.size() + 1) > table_.size()) rehash(std::max<size_t>(64, table_.size() * 2));
+    u32_t h = hash(s);
+    size_t i = probe(s, h);
+    if (table_[i]) return slotId(table_[i]);
+    u32_t id = static_cast<u32_t>(strings_.size());
+    strings_.emplace_back(store(s), s.size());
+    table_[i] = (u64_t(h) << 32) | (id + 1);
+    return id;
+  }
+
+  /// Id of s, npos if absent
+  u32_t find(std::string_view s) const noexcept {
+    if (table_.empty()) return npos;
+    u64_t slot = table_[probe(s, hash(s))];
+    return slot ? slotId(slot) : npos;
+  }
+
+  /// Make room for count strings without rehashing
+  void reserve(size_t count) {
+    size_t slots = 64;
+    while (slots < 2 * count) slots <<= 1;
+    if (slots > table_.size()) rehash(slots);
+    strings_.reserve(count);
+  }
+
+  std::string_view view(u32_t id) const noexcept { return strings_[id]; }
+  size_t size() const noexcept { return strings_.size(); }
+  /// Bytes held by chunks
+  size_t bytes() const noexcept { return chunk_total_; }
+
+ private:
+  static u32_t hash(std::string_view s) noexcept {
+    return static_cast<u32_t>(std::hash<std::string_view>()(s));
+  }
+  static u32_t slotId(u64_t slot) noexcept { return static_cast<u32_t>(slot) - 1; }
+
+  /// The full hash kept in each slot avoids touching string bytes on mismatches and rehash
+  size_t probe(std::string_view s, u32_t h) const noexcept {
+    size_t mask = table_.size() - 1;
+    size_t i = h & mask;
+    while (table_[i] && (static_cast<u32_t>(table_[i] >> 32) != h || strings_[slotId(table_[i])] != s)) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  void rehash(size_t slots) {
+    std::vector<u64_t> old(slots, 0);
+    old.swap(table_);
+    size_t mask = slots - 1;
+    for (u64_t slot : old) {
+      if (!slot) continue;
+      size_t i = (slot >> 32) & mask;
+      while (table_[i]) i = (i + 1) & mask;
+      table_[i] = slot;
+    }
+  }
+
+  const char* store(std::string_view s) {
+    if (s.size() > left_) {
+      size_t bytes = std::max(chunk_bytes_, s.size());
+      chunks_.emplace_back(new char[bytes]);
+      chunk_total_ += bytes;
+      cur_ = chunks_.back().get();
+      left_ = bytes;
+    }
+    char* p = cur_;
+    if (!s.empty()) std::memcpy(p, s.data(), s.size());
+    cur_ += s.size();
+    left_ -= s.size();
+    return p;
+  }
+
+  size_t chunk_bytes_;
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  char* cur_{nullptr};
+  size_t left_{0};
+  size_t chunk_total_{0};
+  std::vector<std::string_view> strings_;
+  /// hash << 32 | (id + 1) of the string in each slot, 0 for empty
+  std::vector<u64_t> table_;
+};
+
+}  // namespace util
+}  // namespace tk
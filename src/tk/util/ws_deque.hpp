@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "tk/util/int_def.h"
+#include "tk/util/noncopy.hpp"
+
+namespace tk {
+namespace util {
+
+/**
+ * @brief Chase-Lev work-stealing deque
+ *
+ * The owner thread pushes and pops at the bottom, any other thread steals from the top.
+ * Follows "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al., PPoPP'13).
+ *
+ * @tparam T Element type, must be trivially copyable (usually a pointer)
+ */
+template <typename T>
+class WsDeque : private Noncopy {
+  static_assert(std::is_trivially_copyable<T>::value, "WsDeque element must be trivially copyable");
+
+  class Ring {
+   public:
+    explicit Ring(i64_t capacity) : mask_(capacity - 1), buf_(new std::atomic<T>[capacity]) {}
+    i64_t capacity() const noexcept { return mask_ + 1; }
+    void put(i64_t i, T x) noexcept { buf_[i & mask_].store(x, std::memory_order_relaxed); }
+    T get(i64_t i) const noexcept { return buf_[i & mask_].load(std::memory_order_relaxed); }
+    Ring* grow(i64_t bottom, i64_t top) const {
+      Ring* r = new Ring(capacity() * 2);
+      for (i64_t i = top; i != bottom; ++i) r->put(i, get(i));
+      return r;
+    }
+
+   private:
+    i64_t mask_;
+    std::unique_ptr<std::atomic<T>[]> buf_;
+  };
+
+ public:
+  /// @param capacity Initial capacity, rounded up to a power of two
+  explicit WsDeque(i64_t capacity = 256) {
+    i64_t cap = 1;
+    while (cap < capacity) cap <<= 1;
+    rings_.emplace_back(new Ring(cap));
+    ring_.store(rings_.back().get(), std::memory_order_relaxed);
+  }
+
+  /// Owner only
+  void push(T x) {
+    i64_t b = bottom_.load(std::memory_order_relaxed);
+    i64_t t = top_.load(std::memory_order_acquire);
+    Ring* r = ring_.load(std::memory_order_relaxed);
+    if (b - t > r->capacity() - 1) {
+      // retired rings stay alive until destruction, a concurrent thief may still read them
+      rings_.emplace_back(r->grow(b, t));
+      r = rings_.back().get();
+      ring_.store(r, std::memory_order_release);
+    }
+    r->put(b, x);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  /// Owner only, LIFO end
+  bool pop(T& out) {
+    i64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Ring* r = ring_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+    out = r->get(b);
+    if (t == b) {
+      // last element, race against thieves
+      bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  /// Any thread, FIFO end
+  bool steal(T& out) {
+    i64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    i64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return false;
+    Ring* r = ring_.load(std::memory_order_acquire);
+    T x = r->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      return false;
+    }
+    out = x;
+    return true;
+  }
+
+  /// Approximate number of elements
+  size_t size() const noexcept {
+    i64_t b = bottom_.load(std::memory_order_relaxed);
+    i64_t t = top_.load(std::memory_order_relaxed);
+    return b > t ? static_cast<size_t>(b - t) : 0;
+  }
+  bool empty() const noexcept { return size() == 0; }
+
+ private:
+  alignas(64) std::atomic<i64_t> top_{0};
+  alignas(64) std::atomic<i64_t> bottom_{0};
+  std::atomic<Ring*> ring_{nullptr};
+  std::vector<std::unique_ptr<Ring>> rings_;
+};
+
+}  // namespace util
+}  // namespace tk
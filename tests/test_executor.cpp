@@ -0,0 +1,468 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tk/graph/executor.hpp"
+#include "tk/graph/incremental.hpp"
+#include "tk/graph/memo.hpp"
+#include "tk/graph/memory_plan.hpp"
+#include "tk/graph/scheduling.hpp"
+#include "tk/util/clock.hpp"
+
+namespace {
+
+class AddNode : public tk::Node {
+ public:
+  AddNode(const std::string& name, int value) : tk::Node(name), value_(value) {}
+  tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+    int sum = value_;
+    for (auto& in : inputs) {
+      if (in.has_value()) sum += std::any_cast<int>(in);
+    }
+    return sum;
+  }
+  void setValue(int value) { value_ = value; }
+
+ private:
+  int value_;
+};
+
+/// Fills its arena buffer with id + sum of inputs, checks that inputs were not overwritten
+class ArenaNode : public tk::Node {
+ public:
+  using tk::Node::Node;
+  tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+    u64_t sum = id();
+    for (auto& in : inputs) {
+      if (!in.has_value()) continue;
+      if (auto* v = std::any_cast<int>(&in)) {
+        sum += *v;
+        continue;
+      }
+      auto buf = std::any_cast<gsl::span<u8_t>>(in);
+      const u64_t* words = reinterpret_cast<const u64_t*>(buf.data());
+      for (size_t i = 1; i < buf.size() / 8; ++i) {
+        if (words[i] != words[0]) corrupted = true;
+      }
+      sum += words[0];
+    }
+    gsl::span<u8_t> out = arena->buffer(this);
+    u64_t* words = reinterpret_cast<u64_t*>(out.data());
+    for (size_t i = 0; i < out.size() / 8; ++i) words[i] = sum;
+    return out;
+  }
+  const tk::MemoryArena* arena{nullptr};
+  static std::atomic<bool> corrupted;
+};
+std::atomic<bool> ArenaNode::corrupted{false};
+
+class ThrowNode : public tk::Node {
+ public:
+  using tk::Node::Node;
+  tk::Packet process(const std::vector<tk::Packet>&) override { throw std::runtime_error("node failed"); }
+};
+
+}  // namespace
+
+TEST(Graph_Test, ExecutorDependencyOrder) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<AddNode>("node 1", 1);
+  tk::Node* n2_1 = g.addNode<AddNode>("node 2-1", 10);
+  tk::Node* n2_2 = g.addNode<AddNode>("node 2-2", 100);
+  tk::Node* n3 = g.addNode<AddNode>("node 3", 1000);
+  n1->link(n2_1);
+  n1->link(n2_2);
+  n2_1->link(n3);
+  n2_2->link(n3);
+
+  tk::GraphExecutor exec(4);
+  for (int i = 0; i < 100; ++i) {
+    auto out = exec.run(g, 0);
+    ASSERT_EQ(out.size(), 1u);
+    EXPECT_EQ(std::any_cast<int>(out[0]), (1 + 10) + (1 + 100) + 1000);
+  }
+}
+
+TEST(Graph_Test, ExecutorWideGraph) {
+  constexpr int kWidth = 1000;
+  std::atomic<int> count{0};
+  struct CountNode : public tk::Node {
+    CountNode(const std::string& name, std::atomic<int>* c) : tk::Node(name), c_(c) {}
+    tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+      c_->fetch_add(1);
+      return static_cast<int>(inputs.size());
+    }
+    std::atomic<int>* c_;
+  };
+  tk::Graph g;
+  tk::Node* src = g.addNode<CountNode>("src", &count);
+  tk::Node* dst = g.addNode<CountNode>("dst", &count);
+  for (int i = 0; i < kWidth; ++i) {
+    tk::Node* n = g.addNode<CountNode>("mid " + std::to_string(i), &count);
+    src->link(n);
+    n->link(dst);
+  }
+  tk::GraphExecutor exec(4);
+  auto out = exec.run(g);
+  EXPECT_EQ(count.load(), kWidth + 2);
+  ASSERT_EQ(out.size(), 1u);
+  EXPECT_EQ(std::any_cast<int>(out[0]), kWidth);
+}
+
+TEST(Graph_Test, ExecutorRethrow) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<tk::Node>("node 1");
+  tk::Node* n2 = g.addNode<ThrowNode>("node 2");
+  n1->link(n2);
+  tk::GraphExecutor exec(2);
+  EXPECT_THROW(exec.run(g), std::runtime_error);
+  tk::Graph empty;
+  EXPECT_TRUE(exec.run(empty).empty());
+}
+
+TEST(Graph_Test, ExecutorProfiler) {
+  struct SleepNode : public tk::Node {
+    SleepNode(const std::string& name, int ms) : tk::Node(name), ms_(ms) {}
+    tk::Packet process(const std::vector<tk::Packet>&) override {
+      std::this_thread::sleep_for(std::chrono::milliseconds(ms_));
+      return {};
+    }
+    int ms_;
+  };
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<SleepNode>("node \"1\"", 1);
+  tk::Node* n2_1 = g.addNode<SleepNode>("node 2-1", 1);
+  tk::Node* n2_2 = g.addNode<SleepNode>("node 2-2", 10);
+  tk::Node* n3 = g.addNode<SleepNode>("node 3", 1);
+  n1->link(n2_1);
+  n1->link(n2_2);
+  n2_1->link(n3);
+  n2_2->link(n3);
+
+  tk::Profiler prof;
+  tk::GraphExecutor exec(2);
+  exec.setProfiler(&prof);
+  exec.run(g);
+  exec.run(g);
+  exec.setProfiler(nullptr);
+  exec.run(g);
+
+  EXPECT_EQ(prof.events().size(), 8u);
+  auto summary = prof.summary(g.size());
+  EXPECT_EQ(summary[n2_2->id()].count, 2u);
+  EXPECT_GE(summary[n2_2->id()].total_ns, 20000000);
+
+  tk::CriticalPath path = prof.criticalPath(g);
+  EXPECT_EQ(path.nodes, (std::vector<tk::Node*>{n1, n2_2, n3}));
+  EXPECT_GE(path.total_ns, 12e6);
+
+  std::ostringstream os;
+  prof.writeChromeTrace(os, g);
+  std::string trace = os.str();
+  EXPECT_EQ(trace.find("{\"displayTimeUnit\""), 0u);
+  EXPECT_NE(trace.find("\"name\":\"node \\\"1\\\"\""), std::string::npos);
+  EXPECT_NE(trace.find("\"name\":\"node 2-2\""), std::string::npos);
+}
+
+TEST(Graph_Test, FusedChains) {
+  // diamond 1 -> (2-1, 2-2) -> 3 followed by the chain 3 -> 4 -> 5, which fuses into one unit
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<AddNode>("node 1", 1);
+  tk::Node* n2_1 = g.addNode<AddNode>("node 2-1", 10);
+  tk::Node* n2_2 = g.addNode<AddNode>("node 2-2", 100);
+  tk::Node* n3 = g.addNode<AddNode>("node 3", 1000);
+  tk::Node* n4 = g.addNode<AddNode>("node 4", 10000);
+  tk::Node* n5 = g.addNode<AddNode>("node 5", 100000);
+  n1->link(n2_1);
+  n1->link(n2_2);
+  n2_1->link(n3);
+  n2_2->link(n3);
+  n3->link(n4);
+  n4->link(n5);
+
+  tk::FusedChains fusion(g.freeze());
+  EXPECT_EQ(fusion.chains(), 1u);
+  EXPECT_EQ(fusion.fusedNodes(), 3u);
+  EXPECT_EQ(fusion.size(), 4u);
+  u32_t k = fusion.unitOf(n3->id());
+  EXPECT_EQ(fusion.unitOf(n4->id()), k);
+  EXPECT_EQ(fusion.unitOf(n5->id()), k);
+  EXPECT_EQ(fusion.head(k), n3->id());
+  EXPECT_EQ(fusion.tail(k), n5->id());
+  EXPECT_NE(fusion.unitOf(n2_1->id()), fusion.unitOf(n1->id()));
+
+  tk::GraphExecutor exec(2);
+  auto out = exec.run(g, 0);
+  ASSERT_EQ(out.size(), 1u);
+  EXPECT_EQ(std::any_cast<int>(out[0]), (1 + 10) + (1 + 100) + 1000 + 10000 + 100000);
+
+  tk::Graph chain;
+  tk::Node* prev = chain.addNode<AddNode>("c 0", 1);
+  for (int i = 1; i < 100; ++i) {
+    tk::Node* n = chain.addNode<AddNode>("c " + std::to_string(i), 1);
+    prev->link(n);
+    prev = n;
+  }
+  tk::FusedChains whole(chain.freeze());
+  EXPECT_EQ(whole.size(), 1u);
+  EXPECT_EQ(whole.fusedNodes(), 100u);
+  out = exec.run(chain, 0);
+  ASSERT_EQ(out.size(), 1u);
+  EXPECT_EQ(std::any_cast<int>(out[0]), 100);
+}
+
+TEST(Graph_Test, ExecutorSharedPlan) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<AddNode>("node 1", 1);
+  tk::Node* n2_1 = g.addNode<AddNode>("node 2-1", 10);
+  tk::Node* n2_2 = g.addNode<AddNode>("node 2-2", 100);
+  tk::Node* n3 = g.addNode<AddNode>("node 3", 1000);
+  n1->link(n2_1);
+  n1->link(n2_2);
+  n2_1->link(n3);
+  n2_2->link(n3);
+  const tk::Plan plan(g);
+  EXPECT_EQ(plan.rootUnits().size(), 1u);
+  EXPECT_EQ(plan.sinks(), std::vector<u32_t>{static_cast<u32_t>(n3->id())});
+  EXPECT_EQ(plan.order().front(), n1->id());
+  EXPECT_EQ(plan.order().back(), n3->id());
+
+  tk::GraphExecutor exec(4);
+  std::atomic<int> wrong{0};
+  std::vector<std::thread> clients;
+  for (int c = 0; c < 8; ++c) {
+    clients.emplace_back([&exec, &plan, &wrong, c]() {
+      for (int i = 0; i < 200; ++i) {
+        int in = c * 1000 + i;
+        auto out = exec.run(plan, in);
+        if (out.size() != 1 || std::any_cast<int>(out[0]) != 2 * (in + 1) + 110 + 1000) wrong.fetch_add(1);
+      }
+    });
+  }
+  for (auto& t : clients) t.join();
+  EXPECT_EQ(wrong.load(), 0);
+}
+
+TEST(Graph_Test, IncrementalRunner) {
+  tk::Graph g;
+  auto* n1 = static_cast<AddNode*>(g.addNode<AddNode>("node 1", 1));
+  auto* n2_1 = static_cast<AddNode*>(g.addNode<AddNode>("node 2-1", 10));
+  auto* n2_2 = static_cast<AddNode*>(g.addNode<AddNode>("node 2-2", 100));
+  tk::Node* n3 = g.addNode<AddNode>("node 3", 1000);
+  tk::Node* n4 = g.addNode<AddNode>("node 4", 10000);
+  n1->link(n2_1);
+  n1->link(n2_2);
+  n2_1->link(n3);
+  n2_2->link(n3);
+  n2_2->link(n4);
+
+  tk::IncrementalRunner inc(g);
+  auto out = inc.run(0);
+  EXPECT_EQ(inc.recomputed(), 5u);
+  EXPECT_EQ(inc.skipped(), 0u);
+  ASSERT_EQ(out.size(), 2u);
+  EXPECT_EQ(std::any_cast<int>(out[0]), 11 + 101 + 1000);
+  EXPECT_EQ(std::any_cast<int>(out[1]), 101 + 10000);
+
+  out = inc.run(0);
+  EXPECT_EQ(inc.recomputed(), 0u);
+  EXPECT_EQ(inc.skipped(), 5u);
+  EXPECT_EQ(std::any_cast<int>(out[0]), 11 + 101 + 1000);
+
+  n2_1->setValue(20);
+  inc.markDirty(n2_1);
+  EXPECT_TRUE(inc.dirty(n3));
+  EXPECT_FALSE(inc.dirty(n4));
+  out = inc.run(0);
+  EXPECT_EQ(inc.recomputed(), 2u);
+  EXPECT_EQ(inc.skipped(), 3u);
+  EXPECT_EQ(std::any_cast<int>(out[0]), 21 + 101 + 1000);
+  EXPECT_EQ(std::any_cast<int>(out[1]), 101 + 10000);
+  EXPECT_EQ(std::any_cast<int>(inc.output(n2_2)), 101);
+
+  inc.markDirty(n1);
+  out = inc.run(5);
+  EXPECT_EQ(inc.recomputed(), 5u);
+  EXPECT_EQ(std::any_cast<int>(out[1]), 106 + 10000);
+}
+
+TEST(Graph_Test, MemoizedNode) {
+  std::atomic<int> calls{0};
+  struct Square : public tk::Node {
+    Square(const std::string& name, std::atomic<int>* c) : tk::Node(name), c_(c) {}
+    tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+      c_->fetch_add(1);
+      int x = std::any_cast<int>(inputs[0]);
+      return x * x;
+    }
+    std::atomic<int>* c_;
+  };
+  tk::MemoPolicy policy;
+  policy.hasher = [](const std::vector<tk::Packet>& in) { return static_cast<u64_t>(std::any_cast<int>(in[0])); };
+  policy.capacity = 4;
+  policy.shards = 1;
+
+  tk::Graph g;
+  EXPECT_THROW(g.addNode<tk::Memoized<Square>>("no hasher", tk::MemoPolicy{}, &calls), std::invalid_argument);
+  EXPECT_EQ(g.size(), 0u);
+  auto* sq = static_cast<tk::Memoized<Square>*>(g.addNode<tk::Memoized<Square>>("square", policy, &calls));
+  const tk::Plan plan(g);
+  tk::GraphExecutor exec(2);
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i) EXPECT_EQ(std::any_cast<int>(exec.run(plan, i)[0]), i * i);
+  }
+  EXPECT_EQ(calls.load(), 4);
+  EXPECT_EQ(sq->misses(), 4u);
+  EXPECT_EQ(sq->hits(), 8u);
+
+  // 4 evicts the least recently used entry 0
+  exec.run(plan, 4);
+  EXPECT_EQ(sq->cached(), 4u);
+  exec.run(plan, 3);
+  EXPECT_EQ(calls.load(), 5);
+  exec.run(plan, 0);
+  EXPECT_EQ(calls.load(), 6);
+}
+
+TEST(Graph_Test, ExecutorCriticalPathPolicy) {
+  std::vector<std::string> order;
+  struct Record : public tk::Node {
+    Record(const std::string& name, std::vector<std::string>* order) : tk::Node(name), order_(order) {}
+    tk::Packet process(const std::vector<tk::Packet>&) override {
+      order_->emplace_back(name());
+      return 0;
+    }
+    std::vector<std::string>* order_;
+  };
+  tk::Graph g;
+  tk::Node* r = g.addNode<Record>("r", &order);
+  tk::Node* b = g.addNode<Record>("b", &order);
+  tk::Node* c = g.addNode<Record>("c", &order);
+  tk::Node* a1 = g.addNode<Record>("a1", &order);
+  tk::Node* a2 = g.addNode<Record>("a2", &order);
+  r->link(b);
+  r->link(c);
+  r->link(a1);
+  a1->link(a2);
+  const tk::Plan plan(g);
+  EXPECT_EQ(plan.height(r->id()), 3u);
+
+  tk::GraphExecutor exec(1);
+  tk::CriticalPathPolicy policy;
+  exec.setPolicy(&policy);
+  exec.run(plan);
+  EXPECT_EQ(order, (std::vector<std::string>{"r", "a1", "a2", "b", "c"}));
+}
+
+TEST(Graph_Test, ExecutorDeadlinePolicy) {
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool open = false;
+  std::vector<int> order;
+  struct Gate : public tk::Node {
+    using tk::Node::Node;
+    tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+      int id = std::any_cast<int>(inputs[0]);
+      std::unique_lock<std::mutex> lk(*mtx);
+      if (id == 0) cv->wait(lk, [this]() { return *open; });
+      order->push_back(id);
+      return id;
+    }
+    std::mutex* mtx;
+    std::condition_variable* cv;
+    bool* open;
+    std::vector<int>* order;
+  };
+  tk::Graph g;
+  auto* gate = static_cast<Gate*>(g.addNode<Gate>("gate"));
+  gate->mtx = &mtx;
+  gate->cv = &cv;
+  gate->open = &open;
+  gate->order = &order;
+  const tk::Plan plan(g);
+
+  tk::GraphExecutor exec(1);
+  tk::DeadlinePolicy policy;
+  exec.setPolicy(&policy);
+  auto now = util::Clock::now();
+  // run 0 occupies the only worker while the others queue up
+  std::thread blocker([&]() { exec.run(plan, 0); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  std::thread none([&]() { exec.run(plan, 3); });
+  std::thread late([&]() { exec.run(plan, 2, now + std::chrono::seconds(10)); });
+  std::thread early([&]() { exec.run(plan, 1, now + std::chrono::seconds(1)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  {
+    std::lock_guard<std::mutex> lk(mtx);
+    open = true;
+  }
+  cv.notify_all();
+  for (auto* t : {&blocker, &none, &late, &early}) t->join();
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3}));
+}
+
+TEST(Graph_Test, MemoryPlan) {
+  // a chain only ever needs two live buffers
+  {
+    tk::Graph g;
+    tk::Node* prev = nullptr;
+    for (int i = 0; i < 10; ++i) {
+      tk::Node* n = g.addNode<ArenaNode>("chain " + std::to_string(i));
+      if (prev) prev->link(n);
+      prev = n;
+    }
+    tk::MemoryPlan plan(g, std::vector<size_t>(10, 1000));
+    EXPECT_EQ(plan.totalBytes(), 10000u);
+    EXPECT_EQ(plan.arenaBytes(), 2024u);
+    EXPECT_EQ(plan.offset(g.node(9)) % plan.alignment(), 0u);
+  }
+
+  // random DAG run in parallel against a serial reference
+  tk::Graph g;
+  constexpr int kNodes = 200;
+  std::vector<tk::Node*> nodes;
+  std::vector<size_t> bytes;
+  std::mt19937 rng(5);
+  for (int i = 0; i < kNodes; ++i) {
+    nodes.push_back(g.addNode<ArenaNode>("node " + std::to_string(i)));
+    bytes.push_back(8 * (1 + rng() % 64));
+    // mostly short edges, so that buffers die early
+    for (int k = 0; k < 2 && i > 0; ++k) nodes[std::max(0, i - 1 - int(rng() % 6))]->link(nodes[i]);
+  }
+  tk::MemoryPlan plan(g, bytes);
+  tk::MemoryArena arena(plan);
+  for (tk::Node* n : nodes) static_cast<ArenaNode*>(n)->arena = &arena;
+  // sink outputs stay live until the end of the run
+  size_t sink_bytes = 0;
+  for (tk::Node* n : nodes) sink_bytes += n->downSize() ? 0 : plan.bytes(n);
+  EXPECT_GE(plan.arenaBytes(), sink_bytes);
+  EXPECT_LT(plan.arenaBytes() * 2, plan.totalBytes());
+  EXPECT_EQ(arena.size(), plan.arenaBytes());
+
+  std::vector<u64_t> expect(kNodes);
+  for (tk::Node* n : g.topoOrder()) {
+    expect[n->id()] = n->id() + (n->upSize() ? 0 : 3);
+    for (size_t j = 0; j < n->upSize(); ++j) expect[n->id()] += expect[n->up(j)->id()];
+  }
+  tk::GraphExecutor exec(4);
+  for (int run = 0; run < 20; ++run) {
+    auto out = exec.run(g, 3);
+    size_t k = 0;
+    for (tk::Node* n : nodes) {
+      if (n->downSize()) continue;
+      ASSERT_LT(k, out.size());
+      auto buf = std::any_cast<gsl::span<u8_t>>(out[k++]);
+      EXPECT_EQ(*reinterpret_cast<const u64_t*>(buf.data()), expect[n->id()]);
+    }
+  }
+  EXPECT_FALSE(ArenaNode::corrupted);
+  EXPECT_THROW(tk::MemoryPlan(g, std::vector<size_t>(3, 8)), std::invalid_argument);
+}
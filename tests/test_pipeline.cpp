@@ -0,0 +1,351 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tk/graph/autoscaler.hpp"
+#include "tk/graph/dot.hpp"
+#include "tk/graph/pipeline.hpp"
+#include "tk/util/buffer.hpp"
+#include "tk/util/clock.hpp"
+
+namespace {
+
+class SlowAdd : public tk::Node {
+ public:
+  SlowAdd(const std::string& name, int value, int sleep_ms = 0) : tk::Node(name), value_(value), sleep_ms_(sleep_ms) {}
+  tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+    if (sleep_ms_) std::this_thread::sleep_for(std::chrono::milliseconds(sleep_ms_));
+    int sum = value_;
+    for (auto& in : inputs) sum += std::any_cast<int>(in);
+    return sum;
+  }
+
+ private:
+  int value_;
+  int sleep_ms_;
+};
+
+/// Sleeps a different time per item so replicas finish out of order
+class Jitter : public tk::Node {
+ public:
+  explicit Jitter(const std::string& name) : tk::Node(name) {}
+  tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+    int item = std::any_cast<int>(inputs[0]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1 + item * 7 % 5));
+    return item;
+  }
+};
+
+class ThrowAt : public tk::Node {
+ public:
+  ThrowAt(const std::string& name, int bad) : tk::Node(name), bad_(bad) {}
+  tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+    if (std::any_cast<int>(inputs[0]) == bad_) throw std::runtime_error("bad item");
+    return inputs[0];
+  }
+
+ private:
+  int bad_;
+};
+
+class BatchDouble : public tk::BatchNode {
+ public:
+  BatchDouble(const std::string& name, tk::BatchPolicy policy) : tk::BatchNode(name, policy) {}
+  std::vector<tk::Packet> processBatch(const std::vector<std::vector<tk::Packet>>& batch) override {
+    max_batch = std::max(max_batch, batch.size());
+    std::vector<tk::Packet> out;
+    for (auto& item : batch) out.emplace_back(2 * std::any_cast<int>(item[0]));
+    return out;
+  }
+  size_t max_batch{0};
+};
+
+}  // namespace
+
+TEST(Graph_Test, PipelineOrder) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<SlowAdd>("node 1", 1);
+  tk::Node* n2_1 = g.addNode<SlowAdd>("node 2-1", 10);
+  tk::Node* n2_2 = g.addNode<SlowAdd>("node 2-2", 100);
+  tk::Node* n3 = g.addNode<SlowAdd>("node 3", 0);
+  n1->link(n2_1);
+  n1->link(n2_2);
+  n2_1->link(n3);
+  n2_2->link(n3);
+
+  tk::Pipeline p(g, 4);
+  constexpr int kItems = 1000;
+  std::thread feeder([&p]() {
+    for (int i = 0; i < kItems; ++i) ASSERT_TRUE(p.push(i));
+    p.close();
+  });
+  std::vector<tk::Packet> out;
+  int count = 0;
+  while (p.pop(out)) {
+    ASSERT_EQ(out.size(), 1u);
+    EXPECT_EQ(std::any_cast<int>(out[0]), 2 * (count + 1) + 110);
+    ++count;
+  }
+  feeder.join();
+  EXPECT_EQ(count, kItems);
+}
+
+TEST(Graph_Test, PipelineOverlap) {
+  tk::Graph g;
+  tk::Node* prev = nullptr;
+  for (int i = 0; i < 4; ++i) {
+    tk::Node* n = g.addNode<SlowAdd>("stage " + std::to_string(i), 1, 5);
+    if (prev) prev->link(n);
+    prev = n;
+  }
+  tk::Pipeline p(g, 2);
+  constexpr int kItems = 20;
+  auto start = util::Clock::now();
+  std::thread feeder([&p]() {
+    for (int i = 0; i < kItems; ++i) p.push(i);
+    p.close();
+  });
+  std::vector<tk::Packet> out;
+  int count = 0;
+  while (p.pop(out)) ++count;
+  feeder.join();
+  EXPECT_EQ(count, kItems);
+  // 4 stages x 20 items x 5ms = 400ms when run one item at a time
+  EXPECT_LT(util::Clock::durationSince(start), 300.f);
+}
+
+TEST(Graph_Test, PipelineRethrow) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<tk::Node>("node 1");
+  tk::Node* n2 = g.addNode<ThrowAt>("node 2", 3);
+  n1->link(n2);
+  tk::Pipeline p(g);
+  for (int i = 0; i < 5; ++i) p.push(i);
+  p.close();
+  std::vector<tk::Packet> out;
+  int count = 0;
+  EXPECT_THROW(while (p.pop(out)) ++count, std::runtime_error);
+  EXPECT_EQ(count, 3);
+}
+
+TEST(Graph_Test, PipelineBatch) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<SlowAdd>("node 1", 0);
+  auto* n2 = static_cast<BatchDouble*>(g.addNode<BatchDouble>("node 2", tk::BatchPolicy{8, std::chrono::milliseconds(20)}));
+  n1->link(n2);
+
+  tk::Pipeline p(g, 64);
+  constexpr int kItems = 50;
+  for (int i = 0; i < kItems; ++i) p.push(i);
+  std::vector<tk::Packet> out;
+  for (int i = 0; i < kItems; ++i) {
+    ASSERT_TRUE(p.pop(out));
+    EXPECT_EQ(std::any_cast<int>(out[0]), 2 * i);
+  }
+  EXPECT_GT(n2->max_batch, 1u);
+  EXPECT_LE(n2->max_batch, 8u);
+
+  // a lone item is flushed once max_wait expires
+  auto start = util::Clock::now();
+  p.push(kItems);
+  ASSERT_TRUE(p.pop(out));
+  EXPECT_EQ(std::any_cast<int>(out[0]), 2 * kItems);
+  EXPECT_LT(util::Clock::durationSince(start), 200.f);
+  p.close();
+  EXPECT_FALSE(p.pop(out));
+}
+
+TEST(Graph_Test, PipelineSharedBuffer) {
+  // fan-out hands the same bytes to both branches, the writer detaches
+  struct Produce : public tk::Node {
+    Produce(const std::string& name, tk::util::BufferPool* pool) : tk::Node(name), pool_(pool) {}
+    tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+      tk::util::Buffer buf = pool_->allocate(256);
+      std::memset(buf.get(), std::any_cast<int>(inputs[0]), buf.size());
+      return buf;
+    }
+    tk::util::BufferPool* pool_;
+  };
+  struct Inspect : public tk::Node {
+    Inspect(const std::string& name, bool write) : tk::Node(name), write_(write) {}
+    tk::Packet process(const std::vector<tk::Packet>& inputs) override {
+      auto buf = std::any_cast<tk::util::Buffer>(inputs[0]);
+      if (write_) buf.get()[0] = 0xff;
+      return static_cast<int>(buf.get_const()[0]);
+    }
+    bool write_;
+  };
+  tk::util::BufferPool pool;
+  {
+    tk::Graph g;
+    tk::Node* src = g.addNode<Produce>("produce", &pool);
+    tk::Node* reader = g.addNode<Inspect>("read", false);
+    tk::Node* writer = g.addNode<Inspect>("write", true);
+    src->link(reader);
+    src->link(writer);
+    tk::Pipeline p(g, 4);
+    constexpr int kItems = 100;
+    for (int i = 0; i < kItems; ++i) {
+      ASSERT_TRUE(p.push(i % 100));
+      std::vector<tk::Packet> out;
+      ASSERT_TRUE(p.pop(out));
+      EXPECT_EQ(std::any_cast<int>(out[0]), i % 100);
+      EXPECT_EQ(std::any_cast<int>(out[1]), 0xff);
+    }
+    p.close();
+  }
+  // one producer buffer plus one detached copy per item, all recycled
+  EXPECT_EQ(pool.allocated() + pool.reused(), 200u);
+  EXPECT_LE(pool.allocated(), 8u);
+
+  tk::util::Buffer a = pool.copyOf("abc", 3);
+  tk::util::Buffer b = a;
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(a.useCount(), 2u);
+  b.get()[0] = 'x';
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a.get_const()[0], 'a');
+  EXPECT_EQ(b.get_const()[0], 'x');
+  EXPECT_TRUE(a.unique());
+}
+
+TEST(Graph_Test, PipelineStatsDot) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<SlowAdd>("fast", 0);
+  tk::Node* n2 = g.addNode<SlowAdd>("slow \"stage\"", 0, 2);
+  n1->link(n2);
+  tk::GraphStats stats(g.size());
+  {
+    tk::Pipeline p(g, 64, nullptr, &stats);
+    for (int i = 0; i < 20; ++i) p.push(i);
+    p.close();
+    std::vector<tk::Packet> out;
+    while (p.pop(out)) {
+    }
+  }
+  tk::NodeStats slow = stats.get(n2->id());
+  EXPECT_EQ(stats.get(n1->id()).count, 20u);
+  EXPECT_EQ(slow.count, 20u);
+  EXPECT_GE(slow.meanNs(), 2e6);
+  EXPECT_EQ(slow.depth_samples, 20u);
+  // the fast stage fills the slow stage's queue
+  EXPECT_GT(slow.depth_max, 1u);
+
+  std::ostringstream os;
+  tk::writeDot(os, g, &stats);
+  std::string dot = os.str();
+  EXPECT_NE(dot.find("n0 -> n1;"), std::string::npos);
+  EXPECT_NE(dot.find("slow \\\"stage\\\"\\n20 calls"), std::string::npos) << dot;
+  EXPECT_NE(dot.find("fillcolor=\"#ff0000\""), std::string::npos) << dot;
+
+  std::ostringstream plain;
+  tk::writeDot(plain, g);
+  EXPECT_EQ(plain.str().find("calls"), std::string::npos);
+}
+
+TEST(Graph_Test, PipelineReplicas) {
+  constexpr int kItems = 80;
+  auto run = [](size_t replicas, bool ordered, std::vector<int>& items) {
+    tk::Graph g;
+    tk::Node* n1 = g.addNode<SlowAdd>("node 1", 0);
+    tk::Node* n2 = g.addNode<Jitter>("node 2");
+    tk::Node* n3 = g.addNode<SlowAdd>("node 3", 0);
+    n1->link(n2);
+    n2->link(n3);
+    n2->setReplicas(replicas, ordered);
+    tk::Pipeline p(g, 16);
+    std::thread feeder([&p]() {
+      for (int i = 0; i < kItems; ++i) p.push(i);
+      p.close();
+    });
+    auto start = util::Clock::now();
+    std::vector<tk::Packet> out;
+    while (p.pop(out)) items.push_back(std::any_cast<int>(out[0]));
+    feeder.join();
+    return util::Clock::now() - start;
+  };
+
+  std::vector<int> serial, ordered, unordered, expected(kItems);
+  for (int i = 0; i < kItems; ++i) expected[i] = i;
+  auto t1 = run(1, true, serial);
+  auto t4 = run(4, true, ordered);
+  run(4, false, unordered);
+  EXPECT_EQ(serial, expected);
+  EXPECT_EQ(ordered, expected);
+  std::sort(unordered.begin(), unordered.end());
+  EXPECT_EQ(unordered, expected);
+  // jitter sums to ~240 ms for one instance
+  EXPECT_LT(t4 * 2, t1);
+}
+
+TEST(Graph_Test, PipelineReplicasRethrow) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<ThrowAt>("node 1", 50);
+  n1->setReplicas(3);
+  tk::Pipeline p(g, 8);
+  std::thread feeder([&p]() {
+    for (int i = 0; i < 1000 && p.push(i); ++i) {
+    }
+    p.close();
+  });
+  std::vector<tk::Packet> out;
+  int count = 0;
+  EXPECT_THROW(
+      {
+        while (p.pop(out)) ASSERT_EQ(std::any_cast<int>(out[0]), count++);
+      },
+      std::runtime_error);
+  EXPECT_LE(count, 50);
+  feeder.join();
+}
+
+TEST(Graph_Test, PipelineAutoscaler) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<SlowAdd>("node 1", 0);
+  tk::Node* n2 = g.addNode<SlowAdd>("node 2", 0, 2);
+  tk::Node* n3 = g.addNode<SlowAdd>("node 3", 0, 2);
+  n1->link(n2);
+  n2->link(n3);
+  n2->setReplicas(4);
+  n3->setReplicas(4);
+  tk::GraphStats stats(g.size());
+  tk::Pipeline p(g, 16, nullptr, &stats);
+  tk::AutoscalePolicy policy;
+  policy.max_total = 6;
+  policy.interval = std::chrono::milliseconds(10);
+  tk::GraphStats small(g.size() - 1);
+  EXPECT_THROW(tk::Autoscaler(p, small, policy), std::invalid_argument);
+  tk::Autoscaler scaler(p, stats, policy);
+  EXPECT_EQ(p.activeReplicas(n2), 1u);
+  EXPECT_EQ(p.activeReplicas(n3), 1u);
+
+  constexpr int kItems = 400;
+  std::thread feeder([&p]() {
+    for (int i = 0; i < kItems; ++i) p.push(i);
+    p.close();
+  });
+  std::vector<tk::Packet> out;
+  int count = 0;
+  size_t max_n2 = 0, max_total = 0;
+  while (p.pop(out)) {
+    EXPECT_EQ(std::any_cast<int>(out[0]), count++);
+    max_n2 = std::max(max_n2, p.activeReplicas(n2));
+    max_total = std::max(max_total, p.activeReplicas(n2) + p.activeReplicas(n3));
+  }
+  feeder.join();
+  EXPECT_EQ(count, kItems);
+  EXPECT_GE(max_n2, 3u);
+  EXPECT_LE(max_total, 6u);
+  EXPECT_GT(scaler.resizes(), 0u);
+
+  // idle stages give their instances back
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  EXPECT_EQ(p.activeReplicas(n2), 1u);
+  EXPECT_EQ(p.activeReplicas(n3), 1u);
+}
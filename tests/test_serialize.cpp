@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "tk/graph/serialize.hpp"
+
+namespace {
+
+class ScaleNode : public tk::Node {
+ public:
+  explicit ScaleNode(const std::string& name) : tk::Node(name) {}
+};
+TK_REGISTER_NODE(ScaleNode, "ScaleNode");
+
+class UnregisteredNode : public tk::Node {
+ public:
+  using tk::Node::Node;
+};
+
+std::string tempPath(const char* name) { return "/tmp/tk_" + std::to_string(::getpid()) + "_" + name; }
+
+}  // namespace
+
+TEST(Graph_Test, SerializeRoundTrip) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<tk::Node>("node 1");
+  tk::Node* n2_1 = g.addNode<ScaleNode>("node 2-1");
+  tk::Node* n2_2 = g.addNode<tk::Node>("node 2-2");
+  tk::Node* n3 = g.addNode<ScaleNode>("node 3");
+  tk::Node* pre = g.addNode<tk::Node>("pre");
+  n1->link(n2_1);
+  n1->link(n2_2);
+  n2_2->link(n3);
+  n2_1->link(n3);
+  pre->link(n1);
+
+  std::string path = tempPath("roundtrip.tkg");
+  tk::saveGraph(g, path);
+  tk::Graph loaded(tk::NodeStorage::ARENA);
+  std::vector<tk::Node*> nodes = tk::loadGraph(path, loaded);
+  ::unlink(path.c_str());
+
+  ASSERT_EQ(loaded.size(), 5u);
+  EXPECT_EQ(nodes.front()->name(), "pre");
+  tk::Node* m3 = nullptr;
+  for (tk::Node* n : nodes) {
+    if (n->name() == "node 3") m3 = n;
+  }
+  ASSERT_NE(m3, nullptr);
+  EXPECT_NE(dynamic_cast<ScaleNode*>(m3), nullptr);
+  ASSERT_EQ(m3->upSize(), 2u);
+  // upstream order is kept
+  EXPECT_EQ(m3->up(0)->name(), "node 2-2");
+  EXPECT_EQ(m3->up(1)->name(), "node 2-1");
+  EXPECT_EQ(loaded.roots().size(), 1u);
+}
+
+TEST(Graph_Test, SerializeErrors) {
+  tk::Graph g;
+  g.addNode<UnregisteredNode>("anonymous");
+  std::string path = tempPath("errors.tkg");
+  EXPECT_THROW(tk::saveGraph(g, path), std::invalid_argument);
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "not a graph file at all, definitely not one";
+  }
+  tk::Graph loaded;
+  EXPECT_THROW(tk::loadGraph(path, loaded), std::runtime_error);
+  ::unlink(path.c_str());
+  EXPECT_THROW(tk::loadGraph(path, loaded), std::runtime_error);
+}
+
+TEST(Graph_Test, SerializeCorrupted) {
+  tk::Graph g;
+  tk::Node* n1 = g.addNode<tk::Node>("node 1");
+  tk::Node* n2 = g.addNode<ScaleNode>("node 2");
+  n1->link(n2);
+  std::string path = tempPath("corrupted.tkg");
+  tk::saveGraph(g, path);
+  std::string valid;
+  {
+    std::ifstream in(path, std::ios::binary);
+    valid.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  auto loadPatched = [&](auto patch) {
+    std::string bytes = valid;
+    tk::detail::FileHeader h;
+    std::memcpy(&h, bytes.data(), sizeof(h));
+    patch(h, bytes);
+    std::memcpy(&bytes[0], &h, sizeof(h));
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+    tk::Graph loaded;
+    EXPECT_THROW(tk::loadGraph(path, loaded), std::runtime_error);
+    // nothing is created from a rejected file
+    EXPECT_EQ(loaded.size(), 0u);
+  };
+  // offset + count * size wraps around to a small value
+  loadPatched([](tk::detail::FileHeader& h, std::string&) {
+    h.types_offset = ~u64_t(0) - 7;
+    h.type_count = 2;
+  });
+  loadPatched([](tk::detail::FileHeader& h, std::string&) { h.strings_offset = ~u64_t(0); });
+  loadPatched([](tk::detail::FileHeader& h, std::string&) { h.nodes_offset += 1; });
+  // upstream index of the second node points at itself
+  loadPatched([](tk::detail::FileHeader& h, std::string& bytes) {
+    u32_t self = 1;
+    std::memcpy(&bytes[h.edges_offset], &self, sizeof(self));
+  });
+  ::unlink(path.c_str());
+}
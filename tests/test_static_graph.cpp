@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <tuple>
+
+#include "tk/graph/static_graph.hpp"
+
+namespace {
+
+struct Source : tk::StaticNode<Source> {
+  int process(int x) { return x + 1; }
+};
+
+struct AddValue : tk::StaticNode<AddValue> {
+  explicit AddValue(int v = 0) : value(v) {}
+  int process(int x) { return x + value; }
+  int value;
+};
+
+struct Join : tk::StaticNode<Join> {
+  int process(int a, int b) { return a * b; }
+};
+
+struct Describe : tk::StaticNode<Describe> {
+  std::string process(int x) {
+    ++calls;
+    return "value " + std::to_string(x);
+  }
+  int calls{0};
+};
+
+}  // namespace
+
+TEST(Graph_Test, StaticGraph) {
+  // the join is node 1, listed before its inputs 2 and 3, the schedule must still run it last
+  using Edges = tk::StaticEdges<tk::StaticEdge<0, 2>, tk::StaticEdge<0, 3>, tk::StaticEdge<2, 1>,
+                                tk::StaticEdge<3, 1>, tk::StaticEdge<0, 4>>;
+  using G = tk::StaticGraph<Edges, Source, Join, AddValue, AddValue, Describe>;
+  static_assert(G::order()[0] == 0, "root runs first");
+  static_assert(G::order()[4] == 1, "join runs last");
+
+  G g(Source(), Join(), AddValue(10), AddValue(100), Describe());
+  auto [join, desc] = g.run(1);
+  static_assert(std::is_same<decltype(desc), std::string>::value, "output types follow process()");
+  EXPECT_EQ(join, (2 + 10) * (2 + 100));
+  EXPECT_EQ(desc, "value 2");
+
+  g.node<2>().value = 20;
+  EXPECT_EQ(std::get<0>(g.run(0)), (1 + 20) * (1 + 100));
+  EXPECT_EQ(g.node<4>().calls, 2);
+}
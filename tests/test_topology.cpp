@@ -0,0 +1,417 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "tk/graph/bfs.hpp"
+#include "tk/graph/frozen.hpp"
+#include "tk/graph/graph.hpp"
+#include "tk/graph/pending.hpp"
+#include "tk/graph/reachability.hpp"
+#include "tk/graph/reduction.hpp"
+
+namespace {
+
+// same topology as test_graph.cpp
+struct SampleGraph {
+  SampleGraph() {
+    n1 = g.addNode<tk::Node>("node 1");
+    n2_1 = g.addNode<tk::Node>("node 2-1");
+    n2_2 = g.addNode<tk::Node>("node 2-2");
+    n3_1 = g.addNode<tk::Node>("node 3-1");
+    n3_2 = g.addNode<tk::Node>("node 3-2");
+    n3_3 = g.addNode<tk::Node>("node 3-3");
+    n4 = g.addNode<tk::Node>("node 4");
+    n5 = g.addNode<tk::Node>("node 5");
+    n1->link(n2_1);
+    n1->link(n2_2);
+    n2_1->link(n3_1);
+    n2_2->link(n3_2);
+    n2_2->link(n3_3);
+    n3_1->link(n4);
+    n3_2->link(n4);
+    n3_3->link(n4);
+    n4->link(n5);
+  }
+  tk::Graph g;
+  tk::Node *n1, *n2_1, *n2_2, *n3_1, *n3_2, *n3_3, *n4, *n5;
+};
+
+std::vector<u32_t> toVector(gsl::span<const u32_t> s) { return std::vector<u32_t>(s.begin(), s.end()); }
+
+// every edge goes forward in Graph::topoOrder()
+bool isTopoOrdered(const tk::Graph& g) {
+  const auto& order = g.topoOrder();
+  std::vector<size_t> pos(g.size());
+  for (size_t i = 0; i < order.size(); ++i) pos[order[i]->id()] = i;
+  for (size_t i = 0; i < g.size(); ++i) {
+    tk::Node* u = g.node(i);
+    for (size_t j = 0; j < u->downSize(); ++j) {
+      if (pos[u->id()] >= pos[u->down(j)->id()]) return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+TEST(Graph_Test, Freeze) {
+  SampleGraph s;
+  tk::FrozenGraph f = s.g.freeze();
+  ASSERT_EQ(f.size(), 8u);
+  EXPECT_EQ(f.edgeSize(), 9u);
+  EXPECT_EQ(f.node(0), s.n1);
+  EXPECT_EQ(toVector(f.successors(s.n1->id())), (std::vector<u32_t>{1, 2}));
+  EXPECT_EQ(toVector(f.successors(s.n2_2->id())), (std::vector<u32_t>{4, 5}));
+  EXPECT_EQ(toVector(f.predecessors(s.n4->id())), (std::vector<u32_t>{3, 4, 5}));
+  EXPECT_EQ(f.inDegree(s.n1->id()), 0u);
+  EXPECT_EQ(f.outDegree(s.n5->id()), 0u);
+
+  // snapshot is not affected by later changes
+  s.n2_2->unlink(s.n3_2);
+  s.n2_1->link(s.n3_2);
+  EXPECT_EQ(toVector(f.successors(s.n2_2->id())), (std::vector<u32_t>{4, 5}));
+  tk::FrozenGraph f2 = s.g.freeze();
+  EXPECT_EQ(toVector(f2.successors(s.n2_1->id())), (std::vector<u32_t>{3, 4}));
+  EXPECT_EQ(toVector(f2.predecessors(s.n3_2->id())), (std::vector<u32_t>{1}));
+}
+
+TEST(Graph_Test, TopoOrder) {
+  SampleGraph s;
+  EXPECT_TRUE(isTopoOrdered(s.g));
+  // backward edges added later force reordering
+  tk::Node* pre = s.g.addNode<tk::Node>("pre");
+  tk::Node* post = s.g.addNode<tk::Node>("post");
+  EXPECT_TRUE(post->link(s.n1));
+  EXPECT_TRUE(s.n5->link(pre));
+  EXPECT_TRUE(isTopoOrdered(s.g));
+  EXPECT_EQ(s.g.topoOrder().front(), post);
+  EXPECT_EQ(s.g.topoOrder().back(), pre);
+  EXPECT_TRUE(s.n2_2->unlink(s.n3_2));
+  EXPECT_TRUE(s.n3_2->link(s.n2_2));
+  EXPECT_TRUE(isTopoOrdered(s.g));
+  EXPECT_EQ(s.n2_2->upSize(), 2u);
+}
+
+TEST(Graph_Test, TopoRejectCycle) {
+  SampleGraph s;
+  EXPECT_FALSE(s.n5->link(s.n1));
+  EXPECT_FALSE(s.n4->link(s.n2_2));
+  EXPECT_FALSE(s.n1->link(s.n1));
+  EXPECT_EQ(s.n5->downSize(), 0u);
+  EXPECT_EQ(s.n1->upSize(), 0u);
+  EXPECT_TRUE(isTopoOrdered(s.g));
+  tk::Graph other;
+  EXPECT_FALSE(s.n5->link(other.addNode<tk::Node>("foreign")));
+}
+
+TEST(Graph_Test, TopoReverseChain) {
+  constexpr int kSize = 2000;
+  tk::Graph g;
+  std::vector<tk::Node*> nodes;
+  for (int i = 0; i < kSize; ++i) nodes.push_back(g.addNode<tk::Node>("node " + std::to_string(i)));
+  // every link is against the insertion order
+  for (int i = kSize - 1; i > 0; --i) ASSERT_TRUE(nodes[i]->link(nodes[i - 1]));
+  EXPECT_TRUE(isTopoOrdered(g));
+  EXPECT_FALSE(nodes[0]->link(nodes[kSize - 1]));
+}
+
+TEST(Graph_Test, ArenaStorage) {
+  struct Tracked : public tk::Node {
+    Tracked(const std::string& name, int* alive) : tk::Node(name), alive_(alive) { ++*alive_; }
+    ~Tracked() override { --*alive_; }
+    int* alive_;
+  };
+  int alive = 0;
+  {
+    tk::Graph g(tk::NodeStorage::ARENA, 4096);
+    EXPECT_EQ(g.storage(), tk::NodeStorage::ARENA);
+    g.reserve(1000);
+    std::vector<tk::Node*> nodes;
+    for (int i = 0; i < 1000; ++i) nodes.push_back(g.addNode<Tracked>("node " + std::to_string(i), &alive));
+    nodes[0]->reserveEdges(999, 0);
+    for (int i = 1; i < 1000; ++i) ASSERT_TRUE(nodes[0]->link(nodes[i]));
+    for (int i = 2; i < 1000; ++i) ASSERT_TRUE(nodes[i - 1]->link(nodes[i]));
+    EXPECT_TRUE(nodes[0]->unlink(nodes[500]));
+    EXPECT_EQ(nodes[0]->downSize(), 998u);
+    EXPECT_EQ(nodes[500]->upSize(), 1u);
+    EXPECT_TRUE(isTopoOrdered(g));
+    EXPECT_EQ(alive, 1000);
+
+    // reserved lists neither grow nor rehash while filled
+    std::pmr::monotonic_buffer_resource arena;
+    tk::EdgeList edges;
+    edges.reset(&arena);
+    edges.reserve(500);
+    for (int i = 0; i < 500; ++i) edges.push_back(nodes[i]);
+    EXPECT_EQ(edges.capacity(), 500u);
+    for (int i = 0; i < 1000; ++i) EXPECT_EQ(edges.contains(nodes[i]), i < 500);
+  }
+  EXPECT_EQ(alive, 0);
+}
+
+TEST(Graph_Test, HubFanOut) {
+  constexpr int kFanOut = 50000;
+  tk::Graph g;
+  tk::Node* hub = g.addNode<tk::Node>("hub");
+  tk::Node* sink = g.addNode<tk::Node>("sink");
+  std::vector<tk::Node*> leaves;
+  for (int i = 0; i < kFanOut; ++i) {
+    leaves.push_back(g.addNode<tk::Node>("leaf " + std::to_string(i)));
+    ASSERT_TRUE(hub->link(leaves.back()));
+    ASSERT_TRUE(leaves.back()->link(sink));
+  }
+  for (int i = 0; i < kFanOut; i += 7) EXPECT_FALSE(hub->link(leaves[i]));
+  for (int i = 0; i < kFanOut; i += 2) ASSERT_TRUE(hub->unlink(leaves[i]));
+  for (int i = 0; i < kFanOut; i += 2) ASSERT_TRUE(leaves[i]->unlink(sink));
+  EXPECT_FALSE(hub->unlink(leaves[0]));
+  EXPECT_EQ(hub->downSize(), static_cast<size_t>(kFanOut / 2));
+  EXPECT_EQ(sink->upSize(), static_cast<size_t>(kFanOut / 2));
+  for (size_t i = 0; i < hub->downSize(); ++i) EXPECT_EQ(hub->down(i)->upSize(), 1u);
+  // inputs keep their link order
+  for (size_t i = 0; i < sink->upSize(); ++i) ASSERT_EQ(sink->up(i), leaves[2 * i + 1]);
+  for (size_t i = 0; i < hub->downSize(); ++i) ASSERT_EQ(hub->down(i), leaves[2 * i + 1]);
+  std::mt19937 rng(1);
+  std::vector<tk::Node*> inputs(sink->upSize());
+  for (size_t i = 0; i < inputs.size(); ++i) inputs[i] = sink->up(i);
+  for (int k = 0; k < 200; ++k) {
+    size_t victim = rng() % inputs.size();
+    ASSERT_TRUE(inputs[victim]->unlink(sink));
+    inputs.erase(inputs.begin() + victim);
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) ASSERT_EQ(sink->up(i), inputs[i]);
+  EXPECT_TRUE(hub->link(leaves[0]));
+  EXPECT_TRUE(isTopoOrdered(g));
+}
+
+TEST(Graph_Test, HubUnlinkKeepsOrder) {
+  // unlinking most edges of a large hub stays linear overall
+  constexpr int kFanOut = 200000;
+  tk::Graph g;
+  tk::Node* hub = g.addNode<tk::Node>("hub");
+  tk::Node* sink = g.addNode<tk::Node>("sink");
+  std::vector<tk::Node*> leaves;
+  for (int i = 0; i < kFanOut; ++i) {
+    leaves.push_back(g.addNode<tk::Node>("leaf " + std::to_string(i)));
+    ASSERT_TRUE(hub->link(leaves.back()));
+    ASSERT_TRUE(leaves.back()->link(sink));
+  }
+  std::mt19937 rng(2);
+  std::vector<char> kept(kFanOut);
+  for (int i = 0; i < kFanOut; ++i) kept[i] = rng() % 10 == 0;
+  for (int i = 0; i < kFanOut; ++i) {
+    if (kept[i]) continue;
+    ASSERT_TRUE(hub->unlink(leaves[i]));
+    ASSERT_TRUE(leaves[i]->unlink(sink));
+    // interleaved reads see a compact list
+    if (i % 5000 == 1) {
+      int first = 0;
+      while (!kept[first] && first <= i) ++first;
+      ASSERT_EQ(sink->up(0), leaves[first]);
+    }
+  }
+  std::vector<tk::Node*> expect;
+  for (int i = 0; i < kFanOut; ++i) {
+    if (kept[i]) expect.push_back(leaves[i]);
+  }
+  ASSERT_EQ(hub->downSize(), expect.size());
+  ASSERT_EQ(sink->upSize(), expect.size());
+  for (size_t i = 0; i < expect.size(); ++i) {
+    ASSERT_EQ(hub->down(i), expect[i]);
+    ASSERT_EQ(sink->up(i), expect[i]);
+  }
+  int removed = static_cast<int>(std::find(kept.begin(), kept.end(), 0) - kept.begin());
+  EXPECT_FALSE(hub->unlink(leaves[removed]));
+  // relinking after compaction appends at the end
+  tk::Node* last = g.addNode<tk::Node>("last");
+  ASSERT_TRUE(hub->link(last));
+  EXPECT_EQ(hub->down(hub->downSize() - 1), last);
+  EXPECT_TRUE(isTopoOrdered(g));
+}
+
+TEST(Graph_Test, RootsAndPendingInputs) {
+  SampleGraph s;
+  ASSERT_EQ(s.g.roots().size(), 1u);
+  EXPECT_EQ(s.g.roots()[0], s.n1);
+  EXPECT_TRUE(s.n1->unlink(s.n2_2));
+  EXPECT_EQ(s.g.roots().size(), 2u);
+  EXPECT_TRUE(s.n1->link(s.n2_2));
+  EXPECT_EQ(s.g.roots().size(), 1u);
+
+  tk::FrozenGraph f = s.g.freeze();
+  EXPECT_EQ(f.roots(), std::vector<u32_t>{0});
+  tk::PendingInputs pending(f);
+  u32_t n4 = s.n4->id();
+  EXPECT_EQ(pending.pending(n4), 3u);
+  EXPECT_FALSE(pending.arrive(n4));
+  EXPECT_FALSE(pending.arrive(n4));
+  EXPECT_TRUE(pending.arrive(n4));
+  pending.reset(f);
+  EXPECT_EQ(pending.pending(n4), 3u);
+}
+
+TEST(Graph_Test, NameIndex) {
+  SampleGraph s;
+  EXPECT_EQ(s.g.find("node 3-2"), s.n3_2);
+  EXPECT_EQ(s.g.find("node 5"), s.n5);
+  EXPECT_EQ(s.g.find("node 6"), nullptr);
+  EXPECT_EQ(s.n2_1->name(), "node 2-1");
+
+  tk::Node* dup = s.g.addNode<tk::Node>("node 4");
+  EXPECT_EQ(s.g.find("node 4"), s.n4);
+  // same name shares storage
+  EXPECT_EQ(dup->name().data(), s.n4->name().data());
+  EXPECT_EQ(s.g.names().size(), 8u);
+
+  tk::Node standalone("a standalone node with a long name");
+  EXPECT_EQ(standalone.name(), "a standalone node with a long name");
+}
+
+TEST(Graph_Test, ParallelBfs) {
+  // dense random DAG, edges only go from lower to higher ids
+  constexpr u32_t kNodes = 20000;
+  tk::Graph g;
+  g.reserve(kNodes);
+  std::vector<tk::Node*> nodes;
+  for (u32_t i = 0; i < kNodes; ++i) nodes.push_back(g.addNode<tk::Node>("n" + std::to_string(i)));
+  std::mt19937 rng(7);
+  for (u32_t i = 0; i + 1 < kNodes; ++i) {
+    nodes[i]->link(nodes[i + 1 + rng() % std::min<u32_t>(kNodes - i - 1, 64)]);
+    for (int k = 0; k < 8; ++k) nodes[i]->link(nodes[i + 1 + rng() % (kNodes - i - 1)]);
+  }
+  tk::FrozenGraph f = g.freeze();
+
+  auto serial = [&f](u32_t src, bool forward) {
+    std::vector<u32_t> level(f.size(), tk::ParallelBfs::kUnreached);
+    std::deque<u32_t> q{src};
+    level[src] = 0;
+    while (!q.empty()) {
+      u32_t u = q.front();
+      q.pop_front();
+      for (u32_t v : forward ? f.successors(u) : f.predecessors(u)) {
+        if (level[v] != tk::ParallelBfs::kUnreached) continue;
+        level[v] = level[u] + 1;
+        q.push_back(v);
+      }
+    }
+    return level;
+  };
+
+  tk::ParallelBfs bfs(4);
+  std::vector<u32_t> expect = serial(0, true);
+  EXPECT_EQ(bfs.run(f, 0), expect);
+  EXPECT_GT(bfs.bottomUpSteps(), 0u);
+  EXPECT_EQ(bfs.reached(), kNodes - std::count(expect.begin(), expect.end(), tk::ParallelBfs::kUnreached));
+  EXPECT_EQ(bfs.run(f, kNodes / 2), serial(kNodes / 2, true));
+  EXPECT_EQ(bfs.run(f, kNodes - 1, tk::ParallelBfs::Direction::UPSTREAM), serial(kNodes - 1, false));
+
+  SampleGraph s;
+  tk::FrozenGraph sf = s.g.freeze();
+  tk::ParallelBfs small(2);
+  small.run(sf, s.n3_1->id());
+  EXPECT_EQ(small.reached(), 3u);
+  EXPECT_EQ(small.level(s.n5->id()), 2u);
+  EXPECT_EQ(small.level(s.n1->id()), tk::ParallelBfs::kUnreached);
+}
+
+TEST(Graph_Test, TransitiveReduction) {
+  SampleGraph s;
+  EXPECT_TRUE(tk::redundantEdges(s.g).empty());
+  s.n1->link(s.n4);
+  s.n2_2->link(s.n5);
+  auto redundant = tk::redundantEdges(s.g);
+  ASSERT_EQ(redundant.size(), 2u);
+  EXPECT_EQ(tk::transitiveReduction(s.g), 2u);
+  EXPECT_EQ(s.n1->downSize(), 2u);
+  EXPECT_EQ(s.n2_2->downSize(), 2u);
+
+  // random DAG against a naive closure, with a budget forcing many column windows
+  constexpr u32_t kNodes = 300;
+  tk::Graph g;
+  std::vector<tk::Node*> nodes;
+  for (u32_t i = 0; i < kNodes; ++i) nodes.push_back(g.addNode<tk::Node>("n" + std::to_string(i)));
+  std::mt19937 rng(3);
+  for (u32_t i = 0; i + 1 < kNodes; ++i) {
+    for (int k = 0; k < 4; ++k) nodes[i]->link(nodes[i + 1 + rng() % std::min<u32_t>(kNodes - i - 1, 20)]);
+  }
+  std::vector<std::vector<bool>> reach(kNodes, std::vector<bool>(kNodes, false));
+  for (u32_t i = kNodes; i-- > 0;) {
+    for (size_t j = 0; j < nodes[i]->downSize(); ++j) {
+      size_t v = nodes[i]->down(j)->id();
+      reach[i][v] = true;
+      for (u32_t w = 0; w < kNodes; ++w) reach[i][w] = reach[i][w] || reach[v][w];
+    }
+  }
+  size_t expect = 0;
+  for (u32_t i = 0; i < kNodes; ++i) {
+    for (size_t j = 0; j < nodes[i]->downSize(); ++j) {
+      size_t v = nodes[i]->down(j)->id();
+      for (size_t k = 0; k < nodes[i]->downSize(); ++k) {
+        if (k != j && reach[nodes[i]->down(k)->id()][v]) {
+          ++expect;
+          break;
+        }
+      }
+    }
+  }
+  auto windowed = tk::redundantEdges(g, 64);
+  EXPECT_GT(expect, 0u);
+  EXPECT_EQ(windowed.size(), expect);
+  EXPECT_EQ(tk::redundantEdges(g).size(), expect);
+  for (auto& e : windowed) EXPECT_TRUE(reach[e.first->id()][e.second->id()]);
+  EXPECT_EQ(tk::transitiveReduction(g), expect);
+  EXPECT_TRUE(tk::redundantEdges(g).empty());
+}
+
+TEST(Graph_Test, ReachabilityIndex) {
+  constexpr u32_t kNodes = 500;
+  tk::Graph g;
+  std::vector<tk::Node*> nodes;
+  for (u32_t i = 0; i < kNodes; ++i) nodes.push_back(g.addNode<tk::Node>("n" + std::to_string(i)));
+  std::mt19937 rng(11);
+  auto randomEdge = [&]() {
+    u32_t a = rng() % kNodes, b = rng() % kNodes;
+    if (a != b) nodes[std::min(a, b)]->link(nodes[std::max(a, b)]);
+  };
+  for (int i = 0; i < 600; ++i) randomEdge();
+
+  tk::ParallelBfs bfs(1);
+  auto check = [&](const tk::ReachabilityIndex& index) {
+    tk::FrozenGraph f = g.freeze();
+    int wrong = 0;
+    for (u32_t x = 0; x < kNodes; x += 7) {
+      bfs.run(f, x);
+      for (u32_t y = 0; y < kNodes; ++y) {
+        bool expect = x != y && bfs.level(y) != tk::ParallelBfs::kUnreached;
+        wrong += index.reachable(nodes[x], nodes[y]) != expect;
+      }
+    }
+    return wrong;
+  };
+
+  tk::ReachabilityIndex bits(g, tk::ReachabilityIndex::Mode::BITSET);
+  tk::ReachabilityIndex chains(g, tk::ReachabilityIndex::Mode::CHAINS);
+  tk::ReachabilityIndex small(g, tk::ReachabilityIndex::Mode::AUTO, 1024);
+  EXPECT_EQ(bits.mode(), tk::ReachabilityIndex::Mode::BITSET);
+  EXPECT_EQ(small.mode(), tk::ReachabilityIndex::Mode::CHAINS);
+  EXPECT_LT(chains.chains(), kNodes);
+  EXPECT_EQ(check(bits), 0);
+  EXPECT_EQ(check(chains), 0);
+
+  // patched on link
+  for (int i = 0; i < 200; ++i) randomEdge();
+  EXPECT_FALSE(bits.stale());
+  EXPECT_FALSE(chains.stale());
+  EXPECT_EQ(check(bits), 0);
+  EXPECT_EQ(check(chains), 0);
+
+  // rebuilt after unlink
+  tk::Node* x = nodes[0];
+  while (x->downSize()) x->unlink(x->down(0));
+  EXPECT_TRUE(chains.stale());
+  EXPECT_EQ(check(chains), 0);
+  EXPECT_EQ(check(bits), 0);
+  EXPECT_FALSE(bits.reachable(x, nodes[1]));
+}